@@ -0,0 +1,143 @@
+/*
+Author: Priyanshu Ranka
+Semester : Spring 2025
+Subject : PRCV
+Description: Builds an HNSW approximate nearest-neighbour index over a binary feature store (e.g. ResNet18_olym.fst),
+so Task 5 can answer a query by walking the graph instead of scanning every embedding.
+-M sets the links per node, -e the candidates tracked while building (efConstruction), -t the thread count.
+The graph is only reproducible with -t 1.
+With -i N an inverted-file (IVF) index with N k-means partitions is built instead (0 = 4 * sqrt(rows)),
+and with -p M 4-bit product-quantization codes with M sub-quantizers (0 = dim / 8, 64x smaller than the floats).
+*/
+
+// Include directives
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "feature_store.h"
+#include "hnsw_index.h"
+#include "ivf_index.h"
+#include "pq_index.h"
+#include "thread_pool.h"
+
+// Namespace declarations
+using namespace std;
+
+// Main function
+int main(int argc, char* argv[])
+{
+    int numThreads = 0;  // 0 = one per core
+    HnswParams params;
+    IvfParams ivfParams;
+    PqParams pqParams;
+    bool buildIvf = false;
+    bool buildPq = false;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-M" && i + 1 < argc)
+        {
+            params.m = stoul(argv[++i]);
+        }
+        else if (arg == "-e" && i + 1 < argc)
+        {
+            params.ef_construction = stoul(argv[++i]);
+        }
+        else if (arg == "-i" && i + 1 < argc)
+        {
+            buildIvf = true;
+            ivfParams.nlist = stoul(argv[++i]);
+        }
+        else if (arg == "-p" && i + 1 < argc)
+        {
+            buildPq = true;
+            pqParams.m = stoul(argv[++i]);
+        }
+        else if (arg == "-t" && i + 1 < argc)
+        {
+            numThreads = stoi(argv[++i]);
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() != 2)
+    {
+        cerr << "Usage: " << argv[0] << " [-M links] [-e ef_construction] [-t threads] <features.fst> <features.hnsw>\n";
+        cerr << "       " << argv[0] << " -i nlist [-t threads] <features.fst> <features.ivf>\n";
+        cerr << "       " << argv[0] << " -p subquantizers [-t threads] <features.fst> <features.pq>\n";
+        return 1;
+    }
+
+    FeatureStore store;
+    if (open_feature_store(args[0].c_str(), store) != 0)
+    {
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    WorkStealingPool pool(numThreads);
+    if (buildIvf)
+    {
+        IvfIndex ivf;
+        int err = ivf.build(pool, store.data, store.rows, store.dim, store.dim, ivfParams);
+        if (err == 0)
+        {
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "Partitioned " << store.rows << " x " << store.dim << " features into " << ivf.lists()
+                 << " lists in " << seconds << " s" << endl;
+            err = ivf.save(args[1].c_str());
+        }
+        if (err == 0)
+        {
+            cout << "Wrote " << args[1] << endl;
+        }
+
+        ivf.close();
+        close_feature_store(store);
+        return err;
+    }
+
+    if (buildPq)
+    {
+        PqIndex pq;
+        int err = pq.build(pool, store.data, store.rows, store.dim, store.dim, pqParams);
+        if (err == 0)
+        {
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "Encoded " << store.rows << " x " << store.dim << " features as " << pq.subquantizers()
+                 << " 4-bit codes in " << seconds << " s" << endl;
+            err = pq.save(args[1].c_str());
+        }
+        if (err == 0)
+        {
+            cout << "Wrote " << args[1] << endl;
+        }
+
+        pq.close();
+        close_feature_store(store);
+        return err;
+    }
+
+    HnswIndex index;
+    int err = index.build(pool, store.data, store.rows, store.dim, store.dim, params);
+    if (err == 0)
+    {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Linked " << store.rows << " x " << store.dim << " features (M " << params.m << ", efConstruction "
+             << params.ef_construction << ") in " << seconds << " s" << endl;
+        err = index.save(args[1].c_str());
+    }
+    if (err == 0)
+    {
+        cout << "Wrote " << args[1] << endl;
+    }
+
+    index.close();
+    close_feature_store(store);
+    return err;
+}
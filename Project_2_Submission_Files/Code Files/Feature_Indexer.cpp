@@ -0,0 +1,266 @@
+/*
+Author: Priyanshu Ranka
+Semester : Spring 2025
+Subject : PRCV
+Description: Offline indexer. Runs every feature extractor of Tasks 1-4 once over an image directory and stores
+the results as one binary feature store per feature, so the query programs only extract features for the target.
+Images are decoded and extracted in parallel on a work-stealing thread pool (-t sets the thread count).
+With -p the staged read -> decode -> extract -> write pipeline is used instead; -m caps the images between decode and write.
+With -r N the histogram features are extracted from a reduced JPEG decode that keeps at least N pixels, and the
+scale used is recorded per row in the index. With -d they are built from the JPEG DC coefficients (one pixel per
+8x8 block, no inverse DCT or upsampling; needs a libjpeg-turbo build), falling back to -r / full decode for other files.
+-f name,name,... restricts indexing to the listed features.
+*/
+
+// Include directives
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <sstream>
+#include <filesystem>
+#include <opencv2/opencv.hpp>
+#include "image_features.h"
+#include "feature_store.h"
+#include "thread_pool.h"
+#include "ingest_pipeline.h"
+#include "image_decode.h"
+#include "fused_features.h"
+
+// Namespace declarations
+using namespace cv;
+using namespace std;
+namespace fs = std::filesystem;
+
+// Main function
+int main(int argc, char* argv[])
+{
+    int numThreads = 0;  // 0 = one per core
+    bool usePipeline = false;
+    size_t maxInFlight = 0;
+    size_t minPixels = 0;  // 0 = always decode at full resolution
+    bool useDc = false;    // histogram features from JPEG DC coefficients
+    string featureList;    // empty = every feature
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+        {
+            numThreads = stoi(argv[++i]);
+        }
+        else if (arg == "-p")
+        {
+            usePipeline = true;
+        }
+        else if (arg == "-m" && i + 1 < argc)
+        {
+            maxInFlight = stoul(argv[++i]);
+        }
+        else if (arg == "-r" && i + 1 < argc)
+        {
+            minPixels = stoul(argv[++i]);
+        }
+        else if (arg == "-d")
+        {
+            useDc = true;
+        }
+        else if (arg == "-f" && i + 1 < argc)
+        {
+            featureList = argv[++i];
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.empty() || args.size() > 2)
+    {
+        cerr << "Usage: " << argv[0] << " [-t threads] [-p [-m max_in_flight]] [-r min_pixels] [-d] [-f features] <image_directory> [index_directory]\n";
+        return 1;
+    }
+
+    string databaseDirectory = args[0];
+    string indexDirectory = (args.size() == 2) ? args[1] : (fs::path(databaseDirectory) / "index").string();
+
+    // Collect image files in a stable (sorted) order
+    vector<string> imagePaths;
+    if (listImageFiles(databaseDirectory, imagePaths) != 0) return 1;
+    try
+    {
+        fs::create_directories(indexDirectory);
+    }
+    catch (const fs::filesystem_error& ex)
+    {
+        cerr << "Error creating index directory: " << ex.what() << endl;
+        return 1;
+    }
+
+    vector<FeatureExtractor> extractors = featureExtractors();
+    if (!featureList.empty())
+    {
+        extractors.clear();
+        stringstream ss(featureList);
+        string name;
+        while (getline(ss, name, ','))
+        {
+            const FeatureExtractor* extractor = findFeatureExtractor(name);
+            if (!extractor)
+            {
+                cerr << "Error: Unknown feature " << name << endl;
+                return 1;
+            }
+            extractors.push_back(*extractor);
+        }
+    }
+
+    if (usePipeline)
+    {
+        PipelineOptions options;
+        options.decoders = numThreads;
+        options.max_in_flight = maxInFlight;
+        options.min_pixels = minPixels;
+        options.dct_dc = useDc;
+        cout << "Indexing " << imagePaths.size() << " files through the ingestion pipeline" << endl;
+        return runIngestPipeline(imagePaths, extractors, indexDirectory, options);
+    }
+
+    // Images are indexed in chunks; each chunk's rows are streamed to the stores in directory order before
+    // the next one starts, so only one chunk of feature vectors is held at a time
+    WorkStealingPool pool(numThreads);
+    const size_t chunkSize = 16 * pool.size();
+    cout << "Indexing " << imagePaths.size() << " files on " << pool.size() << " threads" << endl;
+
+    vector<unique_ptr<FeatureStoreWriter>> stores;
+    vector<size_t> dims(extractors.size(), 0);
+    vector<bool> opened(extractors.size(), false);
+    for (size_t f = 0; f < extractors.size(); f++)
+    {
+        stores.emplace_back(new FeatureStoreWriter());
+    }
+    size_t indexed = 0;
+    int err = 0;
+
+    // scale-invariant features read the reduced decode whenever one was asked for
+    vector<bool> onFull(extractors.size()), onReduced(extractors.size());
+    for (size_t f = 0; f < extractors.size(); f++)
+    {
+        onReduced[f] = (minPixels > 0 || useDc) && extractors[f].scaleInvariant;
+        onFull[f] = !onReduced[f];
+    }
+
+    for (size_t first = 0; first < imagePaths.size() && !err; first += chunkSize)
+    {
+        const size_t count = min(chunkSize, imagePaths.size() - first);
+
+        // features[c][f] = feature f of image first + c; empty if the file is not an image
+        vector<vector<vector<float>>> features(count);
+        vector<uint8_t> scales(count, 1);  // decode scale of the reduced image
+
+        pool.parallel_for(count, [&](size_t c)
+        {
+            const size_t i = first + c;
+            vector<uchar> bytes;
+            if (!readFileBytes(imagePaths[i], bytes))
+            {
+                return;
+            }
+
+            // features that can be read from the file bytes (e.g. a JPEG center patch) skip the decode;
+            // the rest decide which resolutions this image is decoded at
+            vector<vector<float>> row(extractors.size());
+            bool needFull = false, needReduced = false;
+            for (size_t f = 0; f < extractors.size(); f++)
+            {
+                if (extractors[f].extractEncoded)
+                {
+                    row[f] = extractors[f].extractEncoded(bytes);
+                }
+                if (row[f].empty())
+                {
+                    needReduced = needReduced || onReduced[f];
+                    needFull = needFull || onFull[f];
+                }
+            }
+
+            Mat image, reduced;
+            int scale = 1;
+            if (needReduced)
+            {
+                reduced = decodeReduced(bytes, minPixels, scale, useDc);
+            }
+            if (needFull)
+            {
+                image = (needReduced && scale == 1) ? reduced : imdecode(bytes, IMREAD_COLOR);
+            }
+            if ((needFull && image.empty()) || (needReduced && reduced.empty()))
+            {
+                return; // not an image
+            }
+
+            scales[c] = (uint8_t)scale;
+
+            // histograms that read the same image come out of one fused pass over its pixels
+            if (needFull) extractFusedFeatures(image, extractors, onFull, row);
+            if (needReduced) extractFusedFeatures(reduced, extractors, onReduced, row);
+
+            for (size_t f = 0; f < extractors.size(); f++)
+            {
+                if (row[f].empty())
+                {
+                    row[f] = extractors[f].extract(onReduced[f] ? reduced : image);
+                }
+            }
+            features[c] = move(row);
+        });
+
+        // One feature store per feature, rows in directory order
+        for (size_t c = 0; c < count && !err; c++)
+        {
+            if (features[c].empty()) continue;
+
+            const string& path = imagePaths[first + c];
+            string filename = fs::path(path).filename().string();
+            for (size_t f = 0; f < extractors.size() && !err; f++)
+            {
+                const vector<float>& row = features[c][f];
+                if (!opened[f])
+                {
+                    opened[f] = true;
+                    dims[f] = row.size();
+                    err |= stores[f]->open(featureIndexPath(indexDirectory, extractors[f].name).c_str(), dims[f]);
+                }
+                if (row.size() != dims[f])
+                {
+                    cerr << "Error: " << extractors[f].name << " of " << path << " has " << row.size()
+                         << " values, expected " << dims[f] << endl;
+                    err = 1;
+                    break;
+                }
+                err |= stores[f]->append(filename, row.data(), onReduced[f] ? scales[c] : 1);
+            }
+            if (++indexed % 100 == 0)
+            {
+                cout << "Indexed " << indexed << " images" << endl;
+            }
+        }
+    }
+
+    for (size_t f = 0; f < extractors.size(); f++)
+    {
+        string storePath = featureIndexPath(indexDirectory, extractors[f].name);
+        if (!opened[f])
+        {
+            err |= stores[f]->open(storePath.c_str(), 0); // no images: still leave an empty store behind
+        }
+        size_t rows = stores[f]->rows();
+        err |= stores[f]->close();
+        if (!err)
+        {
+            cout << "Wrote " << rows << " x " << dims[f] << " " << extractors[f].name << " -> " << storePath << endl;
+        }
+    }
+
+    return err ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+/*
+Author: Priyanshu Ranka
+Semester : Spring 2025
+Subject : PRCV
+Description: Converts a feature CSV (e.g. ResNet18_olym.csv) into the binary feature store read by the matchers.
+*/
+
+// Include directives
+#include <iostream>
+#include "feature_store.h"
+
+// Namespace declarations
+using namespace std;
+
+// Main function
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        cerr << "Usage: " << argv[0] << " <features.csv> <features.fst>\n";
+        return 1;
+    }
+
+    return convert_csv_to_feature_store(argv[1], argv[2]);
+}
@@ -17,37 +17,29 @@ a 7x7 square centered at the center of the image. The program should display the
 #include <filesystem>
 #include <opencv2/opencv.hpp>
 #include "csv_utils.h"
+#include "image_features.h"
+#include "thread_pool.h"
+#include "image_decode.h"
+#include "jpeg_fast_decode.h"
+#include "distance_kernels.h"
+#include "parallel_search.h"
 
 // Use the cv and std namespaces so that we don't have to prefix cv:: and std:: everywhere
 using namespace cv;
 using namespace std;
 namespace fs = std::filesystem;
 
-// Function to compute the 7x7 square feature vector
-vector<float> computeFeature(const Mat& image) 
+// computeFeature (7x7 square feature vector) lives in image_features.cpp, shared with Feature_Indexer
+
+// Function to compute Sum of Squared Differences (SSD), vectorized in distance_kernels.cpp
+float compute_ssd(const float* f1, const float* f2, size_t n) 
 {
-	int row_start = image.rows / 2 - 3;  // This is the center row of the image
-	int col_start = image.cols / 2 - 3;  // This is the center column of the image
-    
-    vector<float> features;
-    for (int i = row_start; i < row_start + 7; ++i) 
-    {
-        for (int j = col_start; j < col_start + 7; ++j) 
-        {
-            features.push_back(image.at<uchar>(i, j));
-        }
-    }
-	return features; // Returns the 7x7 feature vector
+    return ssdDistance(f1, f2, n); // Squared difference as discussed in the lecture
 }
 
-// Function to compute Sum of Squared Differences (SSD)
 float compute_ssd(const vector<float>& f1, const vector<float>& f2) 
 {
-    float ssd = 0;
-    for (size_t i = 0; i < f1.size(); ++i) {
-		ssd += (f1[i] - f2[i]) * (f1[i] - f2[i]); // Squared difference as discussed in the lecture
-    }
-    return ssd;
+    return compute_ssd(f1.data(), f2.data(), f1.size());
 }
 
 int main(int argc, char* argv[]) // Main function taking the target image path as input arguement
@@ -63,6 +55,7 @@ int main(int argc, char* argv[]) // Main function taking the target image path a
 	string database_directory = "C:\\Users\\yashr\\Desktop\\NEU\\Semester 2\\PRCV\\Projects\\Project_2\\olympus"; // Hardcoded database directory
 	string csv_filename = "image_features.csv"; // Name of the CSV file
 	string csv_filepath = database_directory + "\\" + csv_filename; // Defing the full path to the CSV file
+	string index_directory = database_directory + "\\index"; // Feature stores written by Feature_Indexer
     string feature_type = "7x7"; 
     string matching_method = "SSD"; 
 	int N = 3; // Number of matched images to display (3 as per Task_1)
@@ -87,62 +80,71 @@ int main(int argc, char* argv[]) // Main function taking the target image path a
         return 1;
     }
 
-	// Variables to store image filenames and feature vectors
-    vector<string> image_filenames;
-    vector<vector<float>> image_features;
+    if (matching_method != "SSD")
+    {
+        cerr << "Error: Unknown matching method." << endl;
+        return 1;
+    }
 
-    try 
+	// Keep the N + 1 closest (the best match is the target itself); filenames are looked up for those only.
+	// Scans run on all cores with a per-worker top N + 1 (parallel_search.cpp).
+    vector<pair<float, size_t>> top;
+    vector<pair<float, string>> distances;
+    WorkStealingPool pool;
+
+	// Scan the precomputed features when the index has been built
+    FeatureStore store;
+    if (openFeatureIndex(index_directory, "baseline_7x7", store) == 0 && store.dim == target_features.size())
     {
-		for (const auto& entry : fs::directory_iterator(database_directory)) // Iterate over all files in the database directory
+        top = parallelSsdTopK(pool, target_features.data(), store.data, store.rows, store.dim, N + 1);
+        for (const auto& match : top)
         {
-			if (entry.is_regular_file()) //`Check if the entry is fine or not
-            {
-                string filename = entry.path().filename().string();
-                string image_path = entry.path().string();
-
-				Mat image = imread(image_path, IMREAD_COLOR); // Read the image from the directory
-                if (!image.empty()) 
-                {
-                    vector<float> features;
-                    if (feature_type == "7x7") 
-                    {
-                        features = computeFeature(image);
-                    }
-                    else 
-                    {
-						cerr << "Error: Unknown feature type." << endl; // Error message if the feature not found
-                        return 1;
-                    }
-                    
-                    image_filenames.push_back(filename);
-                    image_features.push_back(features);
-                }
-            }
+            distances.push_back({ match.first, store.filename(match.second) });
         }
+        close_feature_store(store);
     }
-    
-    
-	// Catch block to handle the exception
-    catch (const fs::filesystem_error& ex) 
+    else
     {
-        cerr << "Error accessing database directory: " << ex.what() << endl;
-        return 1;
-    }
-    
-    vector<pair<float, string>> distances;
-    for (size_t i = 0; i < image_features.size(); ++i) {
-        float distance = 0;
-        if (matching_method == "SSD") {
-            distance = compute_ssd(target_features, image_features[i]);
-        }
-        else {
-            cerr << "Error: Unknown matching method." << endl;
+        close_feature_store(store);
+
+		// Variables to store image filenames and feature vectors
+        vector<string> image_filenames;
+        vector<vector<float>> image_features;
+
+        vector<string> image_paths;
+        if (listImageFiles(database_directory, image_paths) != 0) // Files of the database directory in sorted order
+        {
             return 1;
         }
-        distances.push_back({ distance, image_filenames[i] });
-    }
 
-    sort(distances.begin(), distances.end());
+        // Extract on all cores; slot i belongs to image_paths[i] so the order stays stable.
+        // JPEGs only decode the MCUs around the center patch, other formats are decoded in full.
+        vector<vector<float>> extracted(image_paths.size());
+        pool.parallel_for(image_paths.size(), [&](size_t i)
+        {
+            vector<uchar> bytes;
+            if (readFileBytes(image_paths[i], bytes)) // Read the image file from the directory
+            {
+                extracted[i] = computeFeatureFromBytes(bytes);
+            }
+        });
+
+        for (size_t i = 0; i < image_paths.size(); ++i)
+        {
+            if (!extracted[i].empty())
+            {
+                image_filenames.push_back(fs::path(image_paths[i]).filename().string());
+                image_features.push_back(extracted[i]);
+            }
+        }
+
+        top = parallelTopK(pool, image_features.size(), N + 1, false, searchBlockRows(target_features.size() * sizeof(float)),
+                           [&](size_t i, float) { return compute_ssd(target_features, image_features[i]); });
+        for (const auto& match : top)
+        {
+            distances.push_back({ match.first, image_filenames[match.second] });
+        }
+    }
     
     // Display the target image
     namedWindow("Target Image", WINDOW_NORMAL);
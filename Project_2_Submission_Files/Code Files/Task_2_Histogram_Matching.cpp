@@ -16,69 +16,28 @@ and finds the top N images that are most similar to the target image based on hi
 #include <algorithm>
 #include <filesystem>
 #include <opencv2/opencv.hpp>
+#include "image_features.h"
+#include "thread_pool.h"
+#include "distance_kernels.h"
+#include "top_k.h"
+#include "parallel_search.h"
 
 // Define namespaces
 using namespace cv;
 using namespace std;
 namespace fs = std::filesystem;
 
-// Function to compute a 2D color histogram using rg chromaticity
-vector<float> computeHistogram(const Mat& image, int bins = 16)
-{
-	// If image is not present, give error message
-    if (image.empty())
-    {
-        cerr << "Error: Image is empty!" << endl;
-        return {};
-    }
-
-	// Convert image to float and split into RGB channels
-    Mat float_img;
-    image.convertTo(float_img, CV_32F);  // Convert to float for division
-
-    vector<Mat> channels(3);
-    split(float_img, channels);
-
-	// RGB Color space
-    Mat r = channels[2];  // Red channel
-    Mat g = channels[1];  // Green channel
-    Mat b = channels[0];  // Blue channel
-
-	// Compute rg chromaticity
-    Mat sum_rgb = r + g + b + 1e-6;  // Avoid division by zero
-    Mat r_norm = r / sum_rgb;
-    Mat g_norm = g / sum_rgb;
-
-    // Define histogram parameters
-    int histSize[] = { bins, bins };
-    float r_range[] = { 0, 1 };
-    float g_range[] = { 0, 1 };
-    const float* ranges[] = { r_range, g_range };
-    int channelsArray[] = { 0, 1 };
-
-    Mat hist;
-    Mat rg_planes[] = { r_norm, g_norm };
-    calcHist(rg_planes, 2, channelsArray, Mat(), hist, 2, histSize, ranges, true, false);
+// computeHistogram (2D rg chromaticity histogram) lives in image_features.cpp, shared with Feature_Indexer
 
-    // Normalize histogram (sum of all bins = 1)
-    normalize(hist, hist, 1, 0, NORM_L1);
-
-    // Flatten histogram into a vector
-    vector<float> hist_vector;
-    hist_vector.assign((float*)hist.datastart, (float*)hist.dataend);
-
-    return hist_vector;
+// Function to compute histogram intersection (sum of min values), vectorized in distance_kernels.cpp
+float computeHistogramIntersection(const float* h1, const float* h2, size_t n)
+{
+    return intersectionSimilarity(h1, h2, n);  // Higher means more similar
 }
 
-// Function to compute histogram intersection
 float computeHistogramIntersection(const vector<float>& h1, const vector<float>& h2)
 {
-    float intersection = 0;
-    for (size_t i = 0; i < h1.size(); ++i)
-    {
-        intersection += min(h1[i], h2[i]);  // Sum of min values
-    }
-    return intersection;  // Higher means more similar
+    return computeHistogramIntersection(h1.data(), h2.data(), h1.size());
 }
 
 // Main function
@@ -93,6 +52,7 @@ int main(int argc, char* argv[])
 	// Target image path, database directory path and N initializations
     string targetImagePath = argv[1];
     string databaseDirectory = "C:\\Users\\yashr\\Desktop\\NEU\\Semester 2\\PRCV\\Projects\\Project_2\\olympus";
+    string indexDirectory = databaseDirectory + "\\index";  // Feature stores written by Feature_Indexer
     int N = 3;  // Top N matches (as required in thee project)
 
     // Load target image
@@ -111,39 +71,63 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    // Store filenames and histograms of database images
+    // Keep the N + 1 most similar (the best is the target itself), then store their filenames
+    TopK<float> top(N + 1, true);
     vector<pair<float, string>> similarityScores;
+    WorkStealingPool pool;
 
-    try
+    FeatureStore store;
+    if (openFeatureIndex(indexDirectory, "rg_chromaticity", store) == 0 && store.dim == target_histogram.size())
     {
-        for (const auto& entry : fs::directory_iterator(databaseDirectory))
+        // Scan the precomputed histograms on all cores, one top N + 1 per worker
+        auto best = parallelTopK(pool, store.rows, N + 1, true, searchBlockRows(store.dim * sizeof(float)), [&](size_t i, float)
         {
-            if (entry.is_regular_file())
-            {
-                string filename = entry.path().filename().string();
-                string imagePath = entry.path().string();
+            return computeHistogramIntersection(target_histogram.data(), store.row(i), store.dim);
+        });
+        for (const auto& match : best)
+        {
+            similarityScores.push_back({ match.first, store.filename(match.second) });
+        }
+        close_feature_store(store);
+    }
+    else
+    {
+        close_feature_store(store);  // No usable index, extract from the images instead
+        vector<string> imagePaths;
+        if (listImageFiles(databaseDirectory, imagePaths) != 0)  // Sorted, so the result order is stable
+        {
+            return 1;
+        }
 
-                Mat image = imread(imagePath, IMREAD_COLOR);
-                if (!image.empty())
+        // Decode and score the images on all cores
+        vector<float> scores(imagePaths.size());
+        vector<char> valid(imagePaths.size(), 0);
+        pool.parallel_for(imagePaths.size(), [&](size_t i)
+        {
+            Mat image = imread(imagePaths[i], IMREAD_COLOR);
+            if (!image.empty())
+            {
+                vector<float> imageHistogram = computeHistogram(image);
+                if (!imageHistogram.empty())
                 {
-                    vector<float> imageHistogram = computeHistogram(image);
-                    if (!imageHistogram.empty())
-                    {
-                        float similarity = computeHistogramIntersection(target_histogram, imageHistogram);
-                        similarityScores.push_back({ similarity, filename });
-                    }
+                    scores[i] = computeHistogramIntersection(target_histogram, imageHistogram);
+                    valid[i] = 1;
                 }
             }
+        });
+
+        for (size_t i = 0; i < imagePaths.size(); ++i)
+        {
+            if (valid[i])
+            {
+                top.push(scores[i], i);
+            }
+        }
+        for (const auto& match : top.sorted())  // Best matches first
+        {
+            similarityScores.push_back({ match.first, fs::path(imagePaths[match.second]).filename().string() });
         }
     }
-    catch (const fs::filesystem_error& ex)
-    {
-        cerr << "Error accessing database directory: " << ex.what() << endl;
-        return 1;
-    }
-
-    // Sort images by highest similarity score (best matches first)
-    sort(similarityScores.rbegin(), similarityScores.rend());
 
     // Display the target image
     namedWindow("Target Image", WINDOW_NORMAL);
@@ -151,7 +135,7 @@ int main(int argc, char* argv[])
     waitKey(0);
 
     // Display the top N matched images
-    for (int i = 1; i < (N +1); ++i)
+    for (int i = 1; i < min((int)similarityScores.size(), N + 1); ++i)
     {
         string matchedImagePath = databaseDirectory + "\\" + similarityScores[i].second;
         Mat matchedImage = imread(matchedImagePath, IMREAD_COLOR);
@@ -4,6 +4,9 @@ Semester : Spring 2025
 Subject : PRCV
 Task_3: Multi-Histogram Matching
 Description: Uses multiple histograms per image and a custom weighted similarity metric.
+With an optional region of interest (x y width height, in target pixels) images are instead ranked by the
+histogram intersection of that region, assembled from integral histograms (the "rgb_integral" index feature).
+With -s they are ranked by the spatial-pyramid feature (1x1, 2x2 and 4x4 grids, the "rgb_pyramid" index feature).
 */
 
 // Header files
@@ -14,34 +17,31 @@ Description: Uses multiple histograms per image and a custom weighted similarity
 #include <algorithm>
 #include <filesystem>
 #include <opencv2/opencv.hpp>
+#include "image_features.h"
+#include "thread_pool.h"
+#include "integral_histogram.h"
+#include "spatial_pyramid.h"
+#include "distance_kernels.h"
+#include "top_k.h"
+#include "parallel_search.h"
 
 // Namespace
 using namespace cv;
 using namespace std;
 namespace fs = std::filesystem;
 
-// Function to compute a 2D RGB histogram
-Mat computeHistogram(const Mat& image, Rect region, int bins = 8) 
-{
-	// Variables
-    Mat hist;
-    Mat roi = image(region);  // Extract region of interest (ROI)
-
-	int histSize[] = { bins, bins, bins };   // Number of bins
-	float range[] = { 0, 256 };              // Range of pixel values
-    const float* histRange[] = { range, range, range };
-	int channels[] = { 0, 1, 2 };			 // Channels
-
-    calcHist(&roi, 1, channels, Mat(), hist, 3, histSize, histRange, true, false);
-    normalize(hist, hist, 1, 0, NORM_L1);    // Normalize the histogram (for histogram intersection)
+// computeRegionHistogram (3D RGB histogram of a region) lives in image_features.cpp, shared with Feature_Indexer
 
-    return hist;
+// Function to compute histogram intersection (sum of minimum bin values) of flattened histograms
+double histogramIntersection(const float* hist1, const float* hist2, size_t n) 
+{
+    return intersectionSimilarity(hist1, hist2, n);
 }
 
-// Function to compute histogram intersection between two histograms
+// Same as above for two calcHist results (continuous CV_32F), without the temporary min(hist1, hist2) Mat
 double histogramIntersection(const Mat& hist1, const Mat& hist2) 
 {
-    return sum(min(hist1, hist2))[0]; // Sum of minimum bin values
+    return histogramIntersection((const float*)hist1.data, (const float*)hist2.data, min(hist1.total(), hist2.total()));
 }
 
 // Function to compute a weighted similarity score using two histograms
@@ -52,17 +52,158 @@ double computeMultiHistogramSimilarity(const Mat& hist1a, const Mat& hist1b, con
 	return (weight1 * score1 + weight2 * score2);          // Weighted average (Equal)
 }
 
+// Function to rank the database by the histogram intersection of one region of interest. The region is snapped
+// to the integral histogram grid, so every image contributes the same cells whatever its size.
+// similarities receives the k most similar images, best first.
+int computeRegionSimilarities(const Mat& target_image, const Rect& roi, const string& databaseDirectory,
+                              const string& indexDirectory, WorkStealingPool& pool, size_t k,
+                              vector<pair<double, string>>& similarities)
+{
+    IntegralHistogram targetIntegral;
+    if (computeIntegralHistogram(target_image, targetIntegral) != 0)
+    {
+        cerr << "Error: Target image is not 8-bit BGR." << endl;
+        return 1;
+    }
+
+    int row0, col0, row1, col1;
+    snapRegionToCells(roi, target_image.size(), targetIntegral.gridRows, targetIntegral.gridCols, row0, col0, row1, col1);
+    vector<float> targetHist = integralRegionHistogram(targetIntegral, row0, col0, row1, col1);
+
+    TopK<double> top(k, true);
+
+    // Four corner lookups per bin for every indexed image, on all cores
+    FeatureStore store;
+    if (openFeatureIndex(indexDirectory, "rgb_integral", store) == 0 && store.dim == targetIntegral.corners.size())
+    {
+        // one region histogram buffer per worker, so the scan allocates nothing per row
+        vector<vector<float>> scratch(pool.size(), vector<float>(targetHist.size()));
+        auto best = parallelTopK(pool, store.rows, k, true, searchBlockRows(store.dim * sizeof(float)), [&](size_t i, float)
+        {
+            float* hist = scratch[WorkStealingPool::current_worker()].data();
+            integralRegionHistogram(store.row(i), targetIntegral.gridRows, targetIntegral.gridCols, targetIntegral.bins,
+                                    row0, col0, row1, col1, hist);
+            return (float)histogramIntersection(targetHist.data(), hist, targetHist.size());
+        });
+        for (const auto& match : best)
+        {
+            similarities.push_back({ match.first, store.filename(match.second) });
+        }
+        close_feature_store(store);
+        return 0;
+    }
+    close_feature_store(store);
+
+    vector<string> imagePaths;
+    if (listImageFiles(databaseDirectory, imagePaths) != 0)
+    {
+        return 1;
+    }
+
+    vector<double> scores(imagePaths.size());
+    vector<char> valid(imagePaths.size(), 0);
+    pool.parallel_for(imagePaths.size(), [&](size_t i)
+    {
+        IntegralHistogram integral;
+        Mat image = imread(imagePaths[i], IMREAD_COLOR);
+        if (!image.empty() && computeIntegralHistogram(image, integral) == 0)
+        {
+            vector<float> hist = integralRegionHistogram(integral, row0, col0, row1, col1);
+            scores[i] = histogramIntersection(targetHist.data(), hist.data(), hist.size());
+            valid[i] = 1;
+        }
+    });
+
+    for (size_t i = 0; i < imagePaths.size(); i++)
+    {
+        if (valid[i])
+        {
+            top.push(scores[i], i);
+        }
+    }
+    for (const auto& match : top.sorted())
+    {
+        similarities.push_back({ match.first, fs::path(imagePaths[match.second]).filename().string() });
+    }
+    return 0;
+}
+
+// Function to rank the database by weighted spatial-pyramid intersection; similarities receives the k best, best first
+int computePyramidSimilarities(const Mat& target_image, const string& databaseDirectory,
+                               const string& indexDirectory, WorkStealingPool& pool, size_t k,
+                               vector<pair<double, string>>& similarities)
+{
+    const SpatialPyramid& pyramid = defaultSpatialPyramid();
+    vector<float> targetPyramid = computeSpatialPyramid(target_image, pyramid);
+    if (targetPyramid.empty())
+    {
+        cerr << "Error: Target image is not 8-bit BGR." << endl;
+        return 1;
+    }
+
+    TopK<double> top(k, true);
+    FeatureStore store;
+    if (openFeatureIndex(indexDirectory, "rgb_pyramid", store) == 0 && store.dim == targetPyramid.size())
+    {
+        auto best = parallelTopK(pool, store.rows, k, true, searchBlockRows(store.dim * sizeof(float)), [&](size_t i, float)
+        {
+            return spatialPyramidSimilarity(targetPyramid.data(), store.row(i), store.dim);
+        });
+        for (const auto& match : best)
+        {
+            similarities.push_back({ match.first, store.filename(match.second) });
+        }
+        close_feature_store(store);
+        return 0;
+    }
+    close_feature_store(store);
+
+    vector<string> imagePaths;
+    if (listImageFiles(databaseDirectory, imagePaths) != 0)
+    {
+        return 1;
+    }
+
+    vector<double> scores(imagePaths.size());
+    vector<char> valid(imagePaths.size(), 0);
+    pool.parallel_for(imagePaths.size(), [&](size_t i)
+    {
+        Mat image = imread(imagePaths[i], IMREAD_COLOR);
+        vector<float> imagePyramid = image.empty() ? vector<float>() : computeSpatialPyramid(image, pyramid);
+        if (!imagePyramid.empty())
+        {
+            scores[i] = spatialPyramidSimilarity(targetPyramid.data(), imagePyramid.data(), imagePyramid.size());
+            valid[i] = 1;
+        }
+    });
+
+    for (size_t i = 0; i < imagePaths.size(); i++)
+    {
+        if (valid[i])
+        {
+            top.push(scores[i], i);
+        }
+    }
+    for (const auto& match : top.sorted())
+    {
+        similarities.push_back({ match.first, fs::path(imagePaths[match.second]).filename().string() });
+    }
+    return 0;
+}
+
 // Main function
 int main(int argc, char* argv[]) 
 {
-    if (argc != 2) 
+    bool usePyramid = argc == 3 && string(argv[2]) == "-s";
+    if (argc != 2 && argc != 6 && !usePyramid) 
     {
-        cerr << "Usage: " << argv[0] << " <imagePath>" << endl;
+        cerr << "Usage: " << argv[0] << " <imagePath> [-s | x y width height]" << endl;
         return 1;
     }
 
     string targetImagePath = argv[1];
 	string databaseDirectory = "C:\\Users\\yashr\\Desktop\\NEU\\Semester 2\\PRCV\\Projects\\Project_2\\olympus"; // Hardcoded database directory
+	string indexDirectory = databaseDirectory + "\\index";  // Feature stores written by Feature_Indexer
     int N = 3;  // Top N matches (3 required)
 
     // Load target image
@@ -72,50 +213,101 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-	// Get dimensions of target image for histogram computation
+	// Get dimensions of target image (bounds of the region of interest)
     int height = target_image.rows;
     int width = target_image.cols;
 
     // Compute histograms for Upper 2/3 and Lower 2/3
-    Mat targetHistUpper = computeHistogram(target_image, Rect(0, 0, width, (2 * height) / 3));
-    Mat targetHistLower = computeHistogram(target_image, Rect(0, height / 3, width, (2 * height) / 3));
+    Mat targetHistUpper = computeRegionHistogram(target_image, upperRegion(target_image));
+    Mat targetHistLower = computeRegionHistogram(target_image, lowerRegion(target_image));
 
-	vector<pair<double, string>> similarities;  // Vector to store similarity scores
+	vector<pair<double, string>> similarities;  // The N + 1 best matches (the best is the target itself), best first
+    TopK<double> top(N + 1, true);
+    WorkStealingPool pool;
 
-    // Iterate through database images
-    try 
+    FeatureStore upperStore, lowerStore;
+    if (usePyramid)
     {
-        for (const auto& entry : fs::directory_iterator(databaseDirectory)) 
+        if (computePyramidSimilarities(target_image, databaseDirectory, indexDirectory, pool, N + 1, similarities) != 0)
         {
-            if (entry.is_regular_file()) 
-            {
-                string filename = entry.path().filename().string();
-                string imagePath = entry.path().string();
-
-                Mat image = imread(imagePath, IMREAD_COLOR);
-                if (!image.empty()) 
-                {
-                    // Compute histograms for database image (Upper 2/3 and Lower 2/3)
-                    Mat hist_upper = computeHistogram(image, Rect(0, 0, width, (2 * height) / 3));
-                    Mat hist_lower = computeHistogram(image, Rect(0, height / 3, width, (2 * height) / 3));
-
-                    // Compute similarity score (weighted average of histogram intersection)
-                    double similarity = computeMultiHistogramSimilarity(targetHistUpper, targetHistLower, hist_upper, hist_lower);
-                    similarities.push_back({ similarity, filename });
-                }
-            }
+            return 1;
         }
     }
-
-	// Error handling
-    catch (const fs::filesystem_error& ex) 
+    else if (argc == 6)
     {
-        cerr << "Error accessing database directory: " << ex.what() << endl;
-        return 1;
+        // Region of interest query
+        Rect roi(stoi(argv[2]), stoi(argv[3]), stoi(argv[4]), stoi(argv[5]));
+        roi &= Rect(0, 0, width, height);
+        if (roi.area() == 0)
+        {
+            cerr << "Error: Region of interest lies outside the target image." << endl;
+            return 1;
+        }
+        if (computeRegionSimilarities(target_image, roi, databaseDirectory, indexDirectory, pool, N + 1, similarities) != 0)
+        {
+            return 1;
+        }
+    }
+    // Scan the precomputed band histograms when the index has been built
+    else if (openFeatureIndex(indexDirectory, "rgb_upper", upperStore) == 0 && openFeatureIndex(indexDirectory, "rgb_lower", lowerStore) == 0 &&
+        upperStore.rows == lowerStore.rows && upperStore.dim == targetHistUpper.total() && lowerStore.dim == targetHistLower.total())
+    {
+        const float* targetUpper = (const float*)targetHistUpper.datastart;
+        const float* targetLower = (const float*)targetHistLower.datastart;
+        auto best = parallelTopK(pool, upperStore.rows, N + 1, true, searchBlockRows(2 * upperStore.dim * sizeof(float)), [&](size_t i, float)
+        {
+            // Weighted average of histogram intersection (equal weights as in computeMultiHistogramSimilarity)
+            return (float)(0.5 * histogramIntersection(targetUpper, upperStore.row(i), upperStore.dim) +
+                           0.5 * histogramIntersection(targetLower, lowerStore.row(i), lowerStore.dim));
+        });
+        for (const auto& match : best)
+        {
+            similarities.push_back({ match.first, upperStore.filename(match.second) });
+        }
+        close_feature_store(upperStore);
+        close_feature_store(lowerStore);
     }
+    else
+    {
+        close_feature_store(upperStore);  // No usable index, extract from the images instead
+        close_feature_store(lowerStore);
+
+        vector<string> imagePaths;
+        if (listImageFiles(databaseDirectory, imagePaths) != 0)  // Sorted, so the result order is stable
+        {
+            return 1;
+        }
+
+        // Iterate through database images on all cores
+        vector<double> scores(imagePaths.size());
+        vector<char> valid(imagePaths.size(), 0);
+        pool.parallel_for(imagePaths.size(), [&](size_t i)
+        {
+            Mat image = imread(imagePaths[i], IMREAD_COLOR);
+            if (!image.empty()) 
+            {
+                // Compute histograms for database image (Upper 2/3 and Lower 2/3 of its own size)
+                Mat hist_upper = computeRegionHistogram(image, upperRegion(image));
+                Mat hist_lower = computeRegionHistogram(image, lowerRegion(image));
+
+                // Compute similarity score (weighted average of histogram intersection)
+                scores[i] = computeMultiHistogramSimilarity(targetHistUpper, targetHistLower, hist_upper, hist_lower);
+                valid[i] = 1;
+            }
+        });
 
-    // Sort images based on similarity (higher is better)
-    sort(similarities.rbegin(), similarities.rend());
+        for (size_t i = 0; i < imagePaths.size(); i++)
+        {
+            if (valid[i])
+            {
+                top.push(scores[i], i);
+            }
+        }
+        for (const auto& match : top.sorted())  // Higher similarity is better
+        {
+            similarities.push_back({ match.first, fs::path(imagePaths[match.second]).filename().string() });
+        }
+    }
 
     // Display Target Image
     namedWindow("Target Image", WINDOW_NORMAL);
@@ -123,7 +315,7 @@ int main(int argc, char* argv[])
     waitKey(0);
 
     // Display Top N Matched Images
-    for (int i = 1; i < (N+1); ++i) 
+    for (int i = 1; i < min((int)similarities.size(), N + 1); ++i) 
     {
         string matchedImagePath = databaseDirectory + "\\" + similarities[i].second;
         Mat matchedImage = imread(matchedImagePath, IMREAD_COLOR);
@@ -6,140 +6,110 @@
 #include <algorithm>
 #include <numeric>
 #include <opencv2/opencv.hpp>
+#include "image_features.h"
+#include "thread_pool.h"
+#include "fused_features.h"
+#include "feature_matrix.h"
+#include "distance_kernels.h"
+#include "parallel_search.h"
 
 using namespace std;
 using namespace cv;
 
 const string IMAGE_FOLDER = "C:\\Users\\yashr\\Desktop\\NEU\\Semester 2\\PRCV\\Projects\\Project_2\\olympus\\";
+const string INDEX_FOLDER = IMAGE_FOLDER + "index";  // Feature stores written by Feature_Indexer
 
-struct ImageData {
-    string filename;
-    Mat image;
-    vector<float> colorHistogram;
-    vector<float> textureHistogram; // Now for Sobel magnitude
+// Histograms of all images, one contiguous matrix per feature; row i of both belongs to the same image
+struct ImageDatabase {
+    FeatureMatrix color;
+    FeatureMatrix texture; // Now for Sobel magnitude
 };
 
-vector<float> getColorHistogram(const Mat& image) {
-    vector<float> histogram;
-    Mat hsv;
-    cvtColor(image, hsv, COLOR_BGR2HSV);
-
-    int hBins = 30, sBins = 32, vBins = 32;
-    int histSize[] = { hBins, sBins, vBins };
-    float hRanges[] = { 0, 180 }, sRanges[] = { 0, 256 }, vRanges[] = { 0, 256 };
-    const float* ranges[] = { hRanges, sRanges, vRanges };
-    int channels[] = { 0, 1, 2 };
-
-    Mat hist;
-    calcHist(&hsv, 1, channels, Mat(), hist, 3, histSize, ranges, true, false);
-
-    double histSum = 0;
-    for (int i = 0; i < hist.rows; i++) {
-        for (int j = 0; j < hist.cols; j++) {
-            for (int k = 0; k < hist.channels(); k++) {
-                histSum += hist.at<Vec3f>(i, j)[k];
-            }
-        }
-    }
-
-    for (int i = 0; i < hist.rows; i++) {
-        for (int j = 0; j < hist.cols; j++) {
-            for (int k = 0; k < hist.channels(); k++) {
-                histogram.push_back(hist.at<Vec3f>(i, j)[k] / histSum);
-            }
-        }
-    }
-    return histogram;
-}
-
-vector<float> getTextureHistogram(const Mat& image) {
-    Mat gray;
-    cvtColor(image, gray, COLOR_BGR2GRAY);
+// getColorHistogram / getTextureHistogram live in image_features.cpp, shared with Feature_Indexer;
+// computeFusedFeatures (fused_features.cpp) produces both from one pass
 
-    Mat sobelX, sobelY;
-    Sobel(gray, sobelX, CV_32F, 1, 0, 3);
-    Sobel(gray, sobelY, CV_32F, 0, 1, 3);
+// Loads the color and texture histograms stored by Feature_Indexer; returns false if there is no index
+bool readImagesFromIndex(const string& indexDir, ImageDatabase& db) {
+    FeatureStore colorStore, textureStore;
+    bool ok = openFeatureIndex(indexDir, "hsv_color", colorStore) == 0 &&
+              openFeatureIndex(indexDir, "sobel_texture", textureStore) == 0 &&
+              colorStore.rows == textureStore.rows;
 
-    Mat magnitude;
-    magnitude = Mat::zeros(sobelX.size(), CV_32F);
-    for (int i = 0; i < sobelX.rows; i++) {
-        for (int j = 0; j < sobelX.cols; j++) {
-            magnitude.at<float>(i, j) = sqrt(sobelX.at<float>(i, j) * sobelX.at<float>(i, j) + sobelY.at<float>(i, j) * sobelY.at<float>(i, j));
-        }
+    if (ok) {
+        read_feature_store_matrix(colorStore, db.color);
+        read_feature_store_matrix(textureStore, db.texture);
     }
 
-    vector<float> histogram;
-    int histSize = 256;
-    float range[] = { 0, 256 };
-    const float* histRange = { range };
-
-    Mat hist;
-    calcHist(&magnitude, 1, 0, Mat(), hist, 1, &histSize, &histRange, true, false);
-
-    double histSum = 0;
-    for (int i = 0; i < hist.rows; i++) {
-        histSum += hist.at<float>(i);
-    }
-    for (int i = 0; i < hist.rows; i++) {
-        histogram.push_back(hist.at<float>(i) / histSum);
-    }
-
-    return histogram;
+    close_feature_store(colorStore);
+    close_feature_store(textureStore);
+    return ok;
 }
 
-
-vector<ImageData> readImagesFromFolder(const string& folder) {
-    vector<ImageData> images;
+ImageDatabase readImagesFromFolder(const string& folder, WorkStealingPool& pool) {
+    ImageDatabase db;
     vector<String> filenames;
     glob(folder + "*", filenames);
 
-    for (const auto& filename : filenames) {
-        Mat image = imread(filename);
+    // Decode and extract on all cores; slot i belongs to filenames[i] so the order stays stable
+    vector<FusedFeatures> slots(filenames.size());
+    vector<char> decoded(filenames.size(), 0);
+    pool.parallel_for(filenames.size(), [&](size_t i) {
+        Mat image = imread(filenames[i]);
         if (!image.empty()) {
-            ImageData imageData;
-            imageData.filename = filename.substr(folder.length());
-            imageData.image = image;
-            imageData.colorHistogram = getColorHistogram(image);
-            imageData.textureHistogram = getTextureHistogram(image); // Use Sobel magnitude histogram
-            images.push_back(imageData);
+            // HSV and Sobel magnitude histograms in one pass over the pixels
+            computeFusedFeatures(image, slots[i], FUSED_HSV_COLOR | FUSED_SOBEL_TEXTURE);
+            decoded[i] = 1;
+        }
+    });
+
+    for (size_t i = 0; i < filenames.size(); i++) {
+        if (decoded[i]) {
+            if (db.color.empty()) {
+                db.color.reset(slots[i].hsvColor.size());
+                db.texture.reset(slots[i].sobelTexture.size());
+            }
+            string filename = filenames[i].substr(folder.length());
+            db.color.append(filename, slots[i].hsvColor.data());
+            db.texture.append(filename, slots[i].sobelTexture.data());
+            slots[i] = FusedFeatures();
         }
         else {
-            cerr << "Error reading image: " << filename << endl;
+            cerr << "Error reading image: " << filenames[i] << endl;
         }
     }
-    return images;
+    return db;
 }
 
 
-float computeSSD(const vector<float>& hist1, const vector<float>& hist2) {
-    float sum = 0.0;
-    size_t minSize = min(hist1.size(), hist2.size());
-    for (size_t i = 0; i < minSize; i++) {
-        float diff = hist1[i] - hist2[i];
-        sum += diff * diff;
-    }
-    return sum;
+// SSD between a histogram and row i of a feature matrix
+float computeSSD(const vector<float>& hist, const FeatureMatrix& matrix, size_t i) {
+    size_t minSize = min(hist.size(), matrix.dim());
+    return ssdDistance(hist.data(), matrix.row(i), minSize);
 }
 
-vector<pair<float, string>> findTopMatches(const vector<ImageData>& images, const Mat& targetImage, int N, const string& targetFilename) {
-    vector<pair<float, string>> distances;
+vector<pair<float, string>> findTopMatches(const ImageDatabase& db, WorkStealingPool& pool, const Mat& targetImage, int N, const string& targetFilename) {
+    FusedFeatures targetFeatures;
+    computeFusedFeatures(targetImage, targetFeatures, FUSED_HSV_COLOR | FUSED_SOBEL_TEXTURE);
+    const vector<float>& targetColorHist = targetFeatures.hsvColor;
+    const vector<float>& targetTextureHist = targetFeatures.sobelTexture; // Sobel magnitude
 
-    vector<float> targetColorHist = getColorHistogram(targetImage);
-    vector<float> targetTextureHist = getTextureHistogram(targetImage); // Sobel magnitude
+    // Scan on all cores, one top N per worker; ids are rows of the database, and the target's own row (if any) is skipped
+    long targetRow = db.color.find(targetFilename);
+    auto top = parallelTopK(pool, db.color.rows(), max(N, 0), false, 64, [&](size_t i, float bound) {
+        if ((long)i == targetRow) return NAN;
 
-    for (const auto& imgData : images) {
-        if (imgData.filename == targetFilename) continue;
+        float colorDistance = computeSSD(targetColorHist, db.color, i);
+        if (colorDistance > bound) return colorDistance; // The texture term can only add to it
 
-        float colorDistance = computeSSD(targetColorHist, imgData.colorHistogram);
-        float textureDistance = computeSSD(targetTextureHist, imgData.textureHistogram); // Sobel magnitude
+        float textureDistance = computeSSD(targetTextureHist, db.texture, i); // Sobel magnitude
+        return colorDistance + textureDistance; // Equal weighting
+    });
 
-        float distance = colorDistance + textureDistance; // Equal weighting
-        distances.push_back({ distance, imgData.filename });
+    vector<pair<float, string>> distances;
+    for (const auto& match : top) {
+        distances.push_back({ match.first, db.color.filename(match.second) });
     }
-
-    sort(distances.begin(), distances.end());
-    if (N > distances.size()) N = distances.size();
-    return vector<pair<float, string>>(distances.begin(), distances.begin() + N);
+    return distances;
 }
 
 
@@ -186,13 +156,16 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    vector<ImageData> images = readImagesFromFolder(IMAGE_FOLDER);
-    if (images.empty()) return 1;
+    // One pool for the whole run, shared by the folder scan and the search
+    WorkStealingPool pool;
+    ImageDatabase db;
+    if (!readImagesFromIndex(INDEX_FOLDER, db)) db = readImagesFromFolder(IMAGE_FOLDER, pool);
+    if (db.color.empty()) return 1;
 
     size_t lastSlash = targetImage.find_last_of("/\\");
     string targetFilename = (lastSlash != string::npos) ? targetImage.substr(lastSlash + 1) : targetImage;
 
-    vector<pair<float, string>> topMatches = findTopMatches(images, target, N, targetFilename);
+    vector<pair<float, string>> topMatches = findTopMatches(db, pool, target, N, targetFilename);
 
     vector<string> matchFilenames;
     cout << "Top " << N << " matches for " << targetFilename << ":\n";
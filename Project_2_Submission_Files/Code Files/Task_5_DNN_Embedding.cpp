@@ -13,115 +13,141 @@ Description: This code reads the feature vectors of images from a CSV file and f
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <filesystem>
 #include <opencv2/opencv.hpp>
+#include "csv_utils.h"
+#include "feature_store.h"
+#include "feature_matrix.h"
+#include "distance_kernels.h"
+#include "parallel_search.h"
+#include "batch_search.h"
+#include "hnsw_index.h"
+#include "ivf_index.h"
+#include "pq_index.h"
 
 // Namespace declarations
 using namespace std;
 using namespace cv;
+namespace fs = std::filesystem;
 
 // Hardcoded paths
 const string CSV_FILE_PATH = "ResNet18_olym.csv";   // CSV File containing image filenames and feature vectors
+const string STORE_FILE_PATH = "ResNet18_olym.fst"; // Binary feature store made by Feature_Store_Converter (used when present)
+const string HNSW_FILE_PATH = "ResNet18_olym.hnsw"; // HNSW graph over the store made by Build_ANN_Index (used with --hnsw)
+const string IVF_FILE_PATH = "ResNet18_olym.ivf";   // IVF partitions of the store made by Build_ANN_Index -i (used with --ivf)
+const string PQ_FILE_PATH = "ResNet18_olym.pq";     // 4-bit PQ codes of the store made by Build_ANN_Index -p (used with --pq)
 const string IMAGE_FOLDER = "C:\\Users\\yashr\\Desktop\\NEU\\Semester 2\\PRCV\\Projects\\Project_2\\olympus\\";  // Folder containing images
 
-// Structure to store image filename and feature vector
-struct ImageData 
+// Function to read the CSV file into one contiguous feature matrix, a row per image (parsed on all cores)
+FeatureMatrix readCSV() 
 {
-    string filename;
-    vector<float> features;
-};
-
-// Function to read the CSV file and store image data
-vector<ImageData> readCSV() 
-{   // Read the CSV file and store image data in a vector
-    vector<ImageData> images;
-    ifstream file(CSV_FILE_PATH);
-    string line;
-
-	// Error handling: Unable to open file
-    if (!file.is_open()) 
+    FeatureMatrix images;
+
+	// Error handling: Unable to open or parse file
+    if (read_image_data_csv(CSV_FILE_PATH.c_str(), images) != 0) 
     {
-        cerr << "Error: Unable to open file " << CSV_FILE_PATH << endl;
-        return images;
+        cerr << "Error: Unable to read file " << CSV_FILE_PATH << endl;
+        return FeatureMatrix();
     }
 
-	// Read each line of the CSV file
-    while (getline(file, line)) 
-	{   // Read each line of the CSV file
-        stringstream ss(line);
-        string value, fname;
-        vector<float> features;
-
-        // Read the filename (first element)
-        getline(ss, fname, ',');
-
-        // Read the 512 feature values (remaining elements)
-        while (getline(ss, value, ',')) {
-            features.push_back(stof(value));
-        }
-
-		// Ensure correct feature size (Debugging)
-        if (features.size() == 512) { // Ensure correct feature size
-            images.push_back({ fname, features });
-        }
+	// Ensure correct feature size (Debugging)
+    if (images.dim() != 512) 
+    {
+        cerr << "Error: Expected 512 features per image, found " << images.dim() << endl;
+        return FeatureMatrix();
     }
-
-    file.close();
     return images;
 }
 
 // Function to find the feature vector of the target image
-vector<float> getTargetFeatures(const vector<ImageData>& images, const string& targetFilename) 
+vector<float> getTargetFeatures(const FeatureMatrix& images, const string& targetFilename) 
 {
     // Getting features of the target image
-    for (const auto& img : images) 
+    long row = images.find(targetFilename);
+    if (row >= 0) 
     {
-        if (img.filename == targetFilename) 
-        {
-            return img.features;
-        }
+        return vector<float>(images.row(row), images.row(row) + images.dim());
     }
 	// Error handling: Target image not found in database
     cerr << "Error: Target image " << targetFilename << " not found in database!" << endl;
     return {};
 }
 
-// Function to compute SSD distance between two feature vectors
-float computeSSD(const vector<float>& v1, const vector<float>& v2) 
+// Function to find the top N closest images using SSD, excluding the target image itself
+vector<pair<float, string>> findTopMatches(const FeatureMatrix& images, WorkStealingPool& pool, const vector<float>& targetFeatures, int N, const string& targetFilename) 
 {
-    float sum = 0.0;
-    for (size_t i = 0; i < v1.size(); i++) 
+	// N smallest distances by row, scanned on all cores; rows that cannot make the top N are abandoned early
+    long targetRow = images.find(targetFilename);
+    auto top = parallelSsdTopK(pool, targetFeatures.data(), images, max(N, 0), [&](size_t i)
+    {
+        return (long)i == targetRow; // To skip the target image itself
+    });
+
+    // Top N matches by ascending SSD distance
+    vector<pair<float, string>> topMatches;
+    for (const auto& match : top) 
     {
-        float diff = v1[i] - v2[i];
-        sum += diff * diff;
+        topMatches.push_back({ match.first, images.filename(match.second) });
     }
-    return sum;
+    return topMatches;
 }
 
-// Function to find the top N closest images using SSD, excluding the target image itself
-vector<pair<float, string>> findTopMatches(const vector<ImageData>& images, const vector<float>& targetFeatures, int N, const string& targetFilename) 
+// Function to attach filenames to (SSD, row) matches found in the store, by a full scan or an approximate index (HNSW, IVF or PQ)
+vector<pair<float, string>> storeMatches(const FeatureStore& store, const vector<pair<float, size_t>>& top)
 {
-	// variables to store distances
-    vector<pair<float, string>> distances;
+    // Top N matches by ascending SSD distance; only their filenames are looked up
+    vector<pair<float, string>> topMatches;
+    for (const auto& match : top)
+    {
+        topMatches.push_back({ match.first, store.filename(match.second) });
+    }
+    return topMatches;
+}
 
-    for (const auto& img : images) 
+// Function to find the top N closest images by scanning the memory-mapped feature store directly
+vector<pair<float, string>> findTopMatchesInStore(const FeatureStore& store, WorkStealingPool& pool, const float* targetFeatures, int N, long targetRow)
+{
+    // N smallest distances by row, on all cores; rows that cannot make the top N are abandoned early
+    auto top = parallelSsdTopK(pool, targetFeatures, store.data, store.rows, store.dim, max(N, 0), [&](size_t i)
     {
-        // To skip the target image itself
-        if (img.filename == targetFilename) 
-        {
-            continue;
-        }
+        return (long)i == targetRow; // To skip the target image itself
+    });
+    return storeMatches(store, top);
+}
 
-		// Compute SSD distance between target and current image
-        float ssd = computeSSD(targetFeatures, img.features);
-        distances.push_back({ ssd, img.filename });
+// Function to run many queries at once (batch mode): one GEMM-based search, results printed instead of displayed
+int runBatch(WorkStealingPool& pool, const string& queryList, int N)
+{
+    // The whole database as one feature matrix, from the store when present
+    FeatureMatrix images;
+    FeatureStore store;
+    if (fs::exists(STORE_FILE_PATH) && open_feature_store(STORE_FILE_PATH.c_str(), store) == 0)
+    {
+        read_feature_store_matrix(store, images);
+        close_feature_store(store);
     }
+    else
+    {
+        images = readCSV();
+    }
+    if (images.empty()) return 1;
 
-    // Sort by ascending SSD distance
-    sort(distances.begin(), distances.end());
+    vector<size_t> queryRows;   // Rows of the database; each is left out of its own matches
+    if (readBatchQueries(queryList, images, queryRows) != 0) return 1;
 
-    // Get top N matches
-    if (N > distances.size()) N = distances.size();
-    return vector<pair<float, string>>(distances.begin(), distances.begin() + N);
+    SsdBatchIndex index(images);
+    auto results = index.search(pool, queryRows, max(N, 0));
+
+    for (size_t q = 0; q < queryRows.size(); q++) 
+    {
+        cout << images.filename(queryRows[q]) << ":";
+        for (const auto& match : results[q]) 
+        {
+            cout << " " << images.filename(match.second) << " (SSD: " << match.first << ")";
+        }
+        cout << "\n";
+    }
+    return 0;
 }
 
 // Function to display the target image and top matches
@@ -159,9 +185,24 @@ void displayImages(const string& targetImage, const vector<string>& matchImages,
 // Main function
 int main(int argc, char* argv[]) 
 {
-    if (argc != 3) 
+    // One pool for the whole run, shared by every search
+    WorkStealingPool pool;
+    if (argc == 4 && string(argv[1]) == "--batch") 
     {
-        cerr << "Usage: " << argv[0] << " <target_image> <N>\n";
+        return runBatch(pool, argv[2], stoi(argv[3]));
+    }
+    // --hnsw / --ivf / --pq answer from an approximate nearest-neighbour index; efSearch / nprobe / rerank trade speed for recall
+    bool useHnsw = argc >= 4 && string(argv[3]) == "--hnsw";
+    bool useIvf = argc >= 4 && string(argv[3]) == "--ivf";
+    bool usePq = argc >= 4 && string(argv[3]) == "--pq";
+    int efSearch = (useHnsw && argc == 5) ? stoi(argv[4]) : 64;
+    int nprobe = (useIvf && argc == 5) ? stoi(argv[4]) : 8;
+    int rerank = (usePq && argc == 5) ? stoi(argv[4]) : 10;
+    bool useIndex = useHnsw || useIvf || usePq;
+    if (argc != 3 && !(useIndex && argc <= 5)) 
+    {
+        cerr << "Usage: " << argv[0] << " <target_image> <N> [--hnsw [efSearch] | --ivf [nprobe] | --pq [rerank]]\n";
+        cerr << "       " << argv[0] << " --batch <query_list.txt | all> <N>\n";
         return 1;
     }
 
@@ -169,20 +210,64 @@ int main(int argc, char* argv[])
     string targetImage = argv[1];
     int N = stoi(argv[2]);
 
-    // Read CSV file
-    vector<ImageData> images = readCSV();
-    if (images.empty()) return 1;
-
     // Extract only filename from full path
     size_t lastSlash = targetImage.find_last_of("/\\");
     string targetFilename = (lastSlash != string::npos) ? targetImage.substr(lastSlash + 1) : targetImage;
 
-    // Get target image features
-    vector<float> targetFeatures = getTargetFeatures(images, targetFilename);
-    if (targetFeatures.empty()) return 1;
+    vector<pair<float, string>> topMatches;
+    FeatureStore store;
+    if (fs::exists(STORE_FILE_PATH) && open_feature_store(STORE_FILE_PATH.c_str(), store) == 0)
+    {
+        // Search straight from the mapped store, no parsing needed
+        long targetRow = find_feature_store_row(store, targetFilename.c_str());
+        if (targetRow < 0)
+        {
+            cerr << "Error: Target image " << targetFilename << " not found in database!" << endl;
+            return 1;
+        }
+        // Approximate top N from the requested index: the HNSW graph walked with efSearch candidates, the nprobe nearest
+        // IVF partitions, or N * rerank PQ candidates re-ranked exactly
+        auto skipTarget = [&](size_t i) { return (long)i == targetRow; }; // To skip the target image itself
+        const float* targetFeatures = store.row(targetRow);
+        HnswIndex index;
+        IvfIndex ivf;
+        PqIndex pq;
+        if (useHnsw && index.open(HNSW_FILE_PATH.c_str(), store.data, store.rows, store.dim, store.dim) == 0)
+        {
+            topMatches = storeMatches(store, index.search(targetFeatures, max(N, 0), max(efSearch, 1), skipTarget));
+        }
+        else if (useIvf && ivf.open(IVF_FILE_PATH.c_str()) == 0 && ivf.rows() == store.rows && ivf.dim() == store.dim)
+        {
+            topMatches = storeMatches(store, ivf.search(targetFeatures, max(N, 0), max(nprobe, 1), skipTarget));
+        }
+        else if (usePq && pq.open(PQ_FILE_PATH.c_str(), store.data, store.rows, store.dim, store.dim) == 0)
+        {
+            topMatches = storeMatches(store, pq.search(targetFeatures, max(N, 0), max(rerank, 1), skipTarget));
+        }
+        else
+        {
+            if (useIndex) cerr << "No usable index, scanning all features instead" << endl;
+            topMatches = findTopMatchesInStore(store, pool, targetFeatures, N, targetRow);
+        }
+        index.close();
+        ivf.close();
+        pq.close();
+        close_feature_store(store);
+    }
+    else
+    {
+        if (useIndex) cerr << "The approximate indexes need " << STORE_FILE_PATH << ", scanning the CSV instead" << endl;
+        // Read CSV file
+        FeatureMatrix images = readCSV();
+        if (images.empty()) return 1;
+
+        // Get target image features
+        vector<float> targetFeatures = getTargetFeatures(images, targetFilename);
+        if (targetFeatures.empty()) return 1;
 
-    // Find top N matching images, excluding the target image
-    vector<pair<float, string>> topMatches = findTopMatches(images, targetFeatures, N, targetFilename);
+        // Find top N matching images, excluding the target image
+        topMatches = findTopMatches(images, pool, targetFeatures, N, targetFilename);
+    }
 
 	// Debugging: Print top matches
     // Print and store results
@@ -13,154 +13,201 @@ Description: Executing Content Based Image Recognition ie. CBIR for shoe image
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <filesystem>
 #include <opencv2/opencv.hpp>
+#include "csv_utils.h"
+#include "feature_store.h"
+#include "feature_matrix.h"
+#include "histogram_kernels.h"
+#include "distance_kernels.h"
+#include "parallel_search.h"
+#include "batch_search.h"
 
 // Namespaces
 using namespace std;
 using namespace cv;
+namespace fs = std::filesystem;
 
 // Flepaths for Directory and .csv file
 const string CSV_FILE_PATH = "ResNet18_olym.csv";
+const string STORE_FILE_PATH = "ResNet18_olym.fst";   // Binary feature store (used instead of the CSV when present)
 const string IMAGE_FOLDER = "C:\\Users\\yashr\\Desktop\\NEU\\Semester 2\\PRCV\\Projects\\Project_2\\olympus\\";
 
-// Image Variable (Structure)
-struct ImageData 
+// Image database: the DNN features of all images in one contiguous matrix, row i belonging to images[i]
+struct ImageDatabase 
 {
-    string filename;
-    vector<float> features; // DNN features
-    Mat image;             // Image data for color histograms
+    FeatureMatrix features; // DNN features and filenames
+    vector<Mat> images;     // Image data for color histograms
 };
 
-// Function to calculate color histogram features
+// Adds an image whose file can be read, with its DNN features
+void addImage(ImageDatabase& db, const string& filename, const float* features)
+{
+    string imagePath = IMAGE_FOLDER + filename;
+    Mat image = imread(imagePath);
+    if (!image.empty()) {
+        db.features.append(filename, features);
+        db.images.push_back(image);
+    } else {
+        cerr << "Error: Could not read image: " << imagePath << endl;
+    }
+}
+
+// Function to calculate color histogram features (30x32x32 HSV bins, normalized to sum to 1)
 vector<float> getColorHistogram(const Mat& image) 
 {
     vector<float> histogram;
-    if (!image.empty()) 
+    if (!image.empty() && image.type() == CV_8UC3) 
     {
-        Mat hsv;
-        cvtColor(image, hsv, COLOR_BGR2HSV);  // Changing color spcae to HSV
-
-        int hBins = 30, sBins = 32, vBins = 32;     // No of bins
-        int histSize[] = {hBins, sBins, vBins};     // Histogram size
-        float hRanges[] = {0, 180}, sRanges[] = {0, 256}, vRanges[] = {0, 256};
-        const float* ranges[] = {hRanges, sRanges, vRanges};
-        int channels[] = {0, 1, 2};     // 3D histogram
-
-        Mat hist;
-        calcHist(&hsv, 1, channels, Mat(), hist, 3, histSize, ranges, true, false);
-
-        for (int i = 0; i < hist.rows; i++) 
+        // Bins come straight from the BGR pixels, no HSV image is converted
+        HsvBinCounter counter;
+        for (int y = 0; y < image.rows; y++) 
         {
-            for (int j = 0; j < hist.cols; j++) 
-            {
-                for(int k = 0; k < hist.channels(); k++)
-                {
-                    histogram.push_back(hist.at<Vec3f>(i,j)[k]);
-                }
-            }
+            counter.addRow(image.ptr<uchar>(y), image.cols);
         }
+
+        vector<uint32_t> counts(HsvBinCounter::H_BINS * HsvBinCounter::S_BINS * HsvBinCounter::V_BINS);
+        counter.counts(counts.data());
+        histogram = normalizeCountsBySum(counts.data(), (int)counts.size());
     }
     return histogram;
 }
 
-// Reading CSV file
-vector<ImageData> readCSV() 
+// Reading CSV file (parsed on all cores)
+void readCSV(ImageDatabase& db) 
 {
-    vector<ImageData> images;
-    ifstream file(CSV_FILE_PATH);
-    string line;
+    FeatureMatrix all;
 
     // Error handling
-    if (!file.is_open()) 
+    if (read_image_data_csv(CSV_FILE_PATH.c_str(), all) != 0 || all.dim() != 512) 
     {
-        cerr << "Error: Unable to open file " << CSV_FILE_PATH << endl;
-        return images;
+        cerr << "Error: Unable to read 512-d features from " << CSV_FILE_PATH << endl;
+        return;
     }
 
-    while (getline(file, line)) 
+    db.features.reset(all.dim());
+    db.features.reserve(all.rows());
+    for (size_t i = 0; i < all.rows(); i++) 
     {
-        stringstream ss(line);
-        string value, fname;
-        vector<float> features;
+        addImage(db, all.filename(i), all.row(i));
+    }
+}
 
-        getline(ss, fname, ',');
+// Reading the memory-mapped feature store (no text parsing)
+bool readStore(ImageDatabase& db)
+{
+    FeatureStore store;
+    if (!fs::exists(STORE_FILE_PATH) || open_feature_store(STORE_FILE_PATH.c_str(), store) != 0)
+    {
+        return false;
+    }
 
-        // Gettin data from file
-        while (getline(ss, value, ',')) {
-            features.push_back(stof(value));
-        }
+    // a store of other features is ignored, so the CSV is read instead
+    if (store.dim != 512)
+    {
+        cerr << "Warning: " << STORE_FILE_PATH << " has " << store.dim << "-d features, reading "
+             << CSV_FILE_PATH << " instead" << endl;
+        close_feature_store(store);
+        return false;
+    }
 
-        if (features.size() == 512) {
-            string imagePath = IMAGE_FOLDER + fname;
-            Mat image = imread(imagePath);
-            if (!image.empty()) {
-                ImageData imageData;
-                imageData.filename = fname;
-                imageData.features = features;
-                imageData.image = image;
-                images.push_back(imageData);
-            } else {
-                cerr << "Error: Could not read image: " << imagePath << endl;
-            }
-        }
+    db.features.reset(store.dim);
+    db.features.reserve(store.rows);
+    for (size_t i = 0; i < store.rows; i++)
+    {
+        addImage(db, store.filename(i), store.row(i));
     }
 
-    file.close();
-    return images;
+    close_feature_store(store);
+    return true;
 }
 
 // Function to get the features
-vector<float> getTargetFeatures(const vector<ImageData>& images, const string& targetFilename) 
+vector<float> getTargetFeatures(const ImageDatabase& db, const string& targetFilename) 
 {
-    for (const auto& img : images) 
+    long row = db.features.find(targetFilename);
+    if (row >= 0) 
     {
-        if (img.filename == targetFilename) 
-        {
-            vector<float> combinedFeatures = img.features;
-            vector<float> colorHist = getColorHistogram(img.image);
-            combinedFeatures.insert(combinedFeatures.end(), colorHist.begin(), colorHist.end()); //Append color histogram to DNN features
-            return combinedFeatures;
-        }
+        vector<float> combinedFeatures(db.features.row(row), db.features.row(row) + db.features.dim());
+        vector<float> colorHist = getColorHistogram(db.images[row]);
+        combinedFeatures.insert(combinedFeatures.end(), colorHist.begin(), colorHist.end()); //Append color histogram to DNN features
+        return combinedFeatures;
     }
     cerr << "Error: Target image " << targetFilename << " not found in database!" << endl;
     return {};
 }
 
-// Function to compute SSD
-float computeSSD(const vector<float>& v1, const vector<float>& v2) 
-{
-    float sum = 0.0;
-    size_t minSize = min(v1.size(), v2.size()); // Handle potential size differences
-    for (size_t i = 0; i < minSize; i++) {
-        float diff = v1[i] - v2[i];
-        sum += diff * diff;
-    }
-    return sum;
-}
-
 // Get the most similar images
-vector<pair<float, string>> findTopMatches(const vector<ImageData>& images, const vector<float>& targetFeatures, int N, const string& targetFilename) {
-    vector<pair<float, string>> distances;
+vector<pair<float, string>> findTopMatches(const ImageDatabase& db, WorkStealingPool& pool, const vector<float>& targetFeatures, int N, const string& targetFilename) {
+    const FeatureMatrix& features = db.features;
+    size_t dnnSize = min(targetFeatures.size(), features.dim());
 
-    // 
-    for (const auto& img : images) 
+    // N smallest distances by row, scanned on all cores with one top N per worker
+    long targetRow = features.find(targetFilename);
+    auto top = parallelTopK(pool, features.rows(), max(N, 0), false, 16, [&](size_t i, float bound)
     {
         // To skip the target image
-        if (img.filename == targetFilename) 
+        if ((long)i == targetRow) 
+        {
+            return NAN;
+        }
+
+        // SSD of the DNN part first; the colour histogram is only computed for images it leaves in the running
+        float ssd = ssdDistance(targetFeatures.data(), features.row(i), dnnSize);
+        if (ssd > bound || targetFeatures.size() <= dnnSize) 
         {
-            continue;
+            return ssd;
         }
-        vector<float> combinedFeatures = img.features;
-        vector<float> colorHist = getColorHistogram(img.image);
-        combinedFeatures.insert(combinedFeatures.end(), colorHist.begin(), colorHist.end());
-        float ssd = computeSSD(targetFeatures, combinedFeatures);
-        distances.push_back({ssd, img.filename});
+        vector<float> colorHist = getColorHistogram(db.images[i]);
+        size_t histSize = min(targetFeatures.size() - dnnSize, colorHist.size());
+        return ssd + ssdDistance(targetFeatures.data() + dnnSize, colorHist.data(), histSize);
+    });
+
+    // Sorted according to distance value; filenames only for the winners
+    vector<pair<float, string>> distances;
+    for (const auto& match : top) 
+    {
+        distances.push_back({match.first, features.filename(match.second)});
     }
+    return distances;
+}
+
+// Batch mode: DNN features and colour histograms of every image in one matrix, searched for many queries at once
+int runBatch(const ImageDatabase& db, WorkStealingPool& pool, const string& queryList, int N)
+{
+    const size_t dnnDim = db.features.dim();
+    const size_t histDim = HsvBinCounter::H_BINS * HsvBinCounter::S_BINS * HsvBinCounter::V_BINS;
 
-    // Sorting according to distance value
-    sort(distances.begin(), distances.end());
-    if (N > distances.size()) N = distances.size();
-    return vector<pair<float, string>>(distances.begin(), distances.begin() + N);
+    // Same layout as getTargetFeatures: DNN features followed by the colour histogram (computed on all cores)
+    FeatureMatrix combined(dnnDim + histDim);
+    combined.reserve(db.features.rows());
+    for (size_t i = 0; i < db.features.rows(); i++) 
+    {
+        float* row = combined.append(db.features.filename(i));
+        copy(db.features.row(i), db.features.row(i) + dnnDim, row);
+    }
+    pool.parallel_for(combined.rows(), [&](size_t i) 
+    {
+        vector<float> colorHist = getColorHistogram(db.images[i]);
+        copy(colorHist.begin(), colorHist.end(), combined.row(i) + dnnDim);
+    });
+
+    vector<size_t> queryRows;   // Rows of the database; each is left out of its own matches
+    if (readBatchQueries(queryList, combined, queryRows) != 0) return 1;
+
+    SsdBatchIndex index(combined);
+    auto results = index.search(pool, queryRows, max(N, 0));
+
+    for (size_t q = 0; q < queryRows.size(); q++) 
+    {
+        cout << combined.filename(queryRows[q]) << ":";
+        for (const auto& match : results[q]) 
+        {
+            cout << " " << combined.filename(match.second) << " (SSD: " << match.first << ")";
+        }
+        cout << "\n";
+    }
+    return 0;
 }
 
 // Function to Display the images
@@ -195,9 +242,18 @@ void displayImages(const string& targetImage, const vector<string>& matchImages,
 //Main Fucntion
 int main(int argc, char* argv[]) 
 {
+    // One pool for the whole run, shared by every search
+    WorkStealingPool pool;
+    if (argc == 4 && string(argv[1]) == "--batch") 
+    {
+        ImageDatabase db;
+        if (!readStore(db)) readCSV(db);
+        return runBatch(db, pool, argv[2], stoi(argv[3]));
+    }
     if (argc != 3) 
     {
         cerr << "Usage: " << argv[0] << " <target_image> <N>\n";
+        cerr << "       " << argv[0] << " --batch <query_list.txt | all> <N>\n";
         return 1;
     }
 
@@ -205,17 +261,18 @@ int main(int argc, char* argv[])
     string targetImage = argv[1];
     int N = stoi(argv[2]);
 
-    vector<ImageData> images = readCSV();
+    ImageDatabase db;
+    if (!readStore(db)) readCSV(db);
     
     size_t lastSlash = targetImage.find_last_of("/\\");
     string targetFilename = (lastSlash != string::npos) ? targetImage.substr(lastSlash + 1) : targetImage;
 
     // Target image features
-    vector<float> targetFeatures = getTargetFeatures(images, targetFilename);
+    vector<float> targetFeatures = getTargetFeatures(db, targetFilename);
     if (targetFeatures.empty()) return 1;
 
     // Finding top Matches
-    vector<pair<float, string>> topMatches = findTopMatches(images, targetFeatures, N, targetFilename);
+    vector<pair<float, string>> topMatches = findTopMatches(db, pool, targetFeatures, N, targetFilename);
 
     // Displaying Image Number and SSD from target image
     vector<string> matchFilenames;
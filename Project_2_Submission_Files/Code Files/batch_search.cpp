@@ -0,0 +1,128 @@
+// batch_search.cpp
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "batch_search.h"
+#include "distance_kernels.h"
+#include "feature_matrix.h"
+#include "top_k.h"
+
+using namespace std;
+
+// Queries per task, and database rows per gemm: a 64 x 1024 block of dot products is 256 KB
+static const size_t QUERY_BLOCK = 64;
+static const size_t ROW_BLOCK = 1024;
+static const size_t MIN_MARGIN = 16; // extra shortlisted rows per query, at least k
+
+// Rows [first, last) of a feature matrix as a Mat header over its buffer (the padded stride becomes the step)
+static cv::Mat rowBlock(const FeatureMatrix& matrix, size_t first, size_t last)
+{
+    return cv::Mat((int)(last - first), (int)matrix.dim(), CV_32F, (void*)matrix.row(first), matrix.stride() * sizeof(float));
+}
+
+SsdBatchIndex::SsdBatchIndex(const FeatureMatrix& database) : database(database), rowNorms(database.rows())
+{
+    for (size_t i = 0; i < database.rows(); i++) {
+        rowNorms[i] = dotProduct(database.row(i), database.row(i), database.dim());
+    }
+}
+
+vector<vector<pair<float, size_t>>> SsdBatchIndex::search(WorkStealingPool& pool, const vector<size_t>& queryRows,
+                                                           size_t k) const
+{
+    const size_t dim = database.dim();
+    const size_t n = database.rows();
+    const size_t nqueries = queryRows.size();
+    vector<vector<pair<float, size_t>>> results(nqueries);
+    if (k == 0 || n == 0 || dim == 0) return results;
+    const size_t shortlist = k + max(k, MIN_MARGIN);
+
+    pool.parallel_for((nqueries + QUERY_BLOCK - 1) / QUERY_BLOCK, [&](size_t block)
+    {
+        const size_t q0 = block * QUERY_BLOCK;
+        const size_t nq = min(nqueries, q0 + QUERY_BLOCK) - q0;
+        const size_t* rows = &queryRows[q0];
+
+        // consecutive rows (e.g. "all") are used in place; other blocks are gathered
+        bool consecutive = true;
+        for (size_t j = 1; j < nq; j++) {
+            consecutive = consecutive && rows[j] == rows[0] + j;
+        }
+        cv::Mat q;
+        if (consecutive) {
+            q = rowBlock(database, rows[0], rows[0] + nq);
+        }
+        else {
+            q.create((int)nq, (int)dim, CV_32F);
+            for (size_t j = 0; j < nq; j++) {
+                copy(database.row(rows[j]), database.row(rows[j]) + dim, q.ptr<float>((int)j));
+            }
+        }
+
+        vector<TopK<float>> tops(nq, TopK<float>(shortlist));
+        cv::Mat dots; // nq x rows of the block, reused across blocks
+        for (size_t r0 = 0; r0 < n; r0 += ROW_BLOCK) {
+            const size_t r1 = min(n, r0 + ROW_BLOCK);
+            cv::gemm(q, rowBlock(database, r0, r1), 1.0, cv::Mat(), 0.0, dots, cv::GEMM_2_T);
+
+            for (size_t j = 0; j < nq; j++) {
+                const float* d = dots.ptr<float>((int)j);
+                const size_t self = rows[j];
+                for (size_t i = r0; i < r1; i++) {
+                    if (i == self) continue;
+                    // rounding can take a near-zero distance just below 0
+                    tops[j].push(max(0.0f, rowNorms[self] + rowNorms[i] - 2.0f * d[i - r0]), i);
+                }
+            }
+        }
+
+        // re-score the shortlist directly and keep the best k; summed in the same chunks as the one-query
+        // search (an unbounded ssdDistanceBounded), so the distances match it bit for bit
+        for (size_t j = 0; j < nq; j++) {
+            TopK<float> exact(k);
+            for (const auto& e : tops[j].sorted()) {
+                exact.push(ssdDistanceBounded(database.row(rows[j]), database.row(e.second), dim, INFINITY), e.second);
+            }
+            results[q0 + j] = exact.sorted();
+        }
+    });
+    return results;
+}
+
+int readBatchQueries(const string& queryList, const FeatureMatrix& database, vector<size_t>& queryRows)
+{
+    queryRows.clear();
+
+    if (queryList == "all") {
+        queryRows.resize(database.rows());
+        for (size_t i = 0; i < database.rows(); i++) {
+            queryRows[i] = i;
+        }
+        return 0;
+    }
+
+    ifstream in(queryList);
+    if (!in) {
+        cerr << "Error: Unable to open query list " << queryList << endl;
+        return 1;
+    }
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        // Extract only filename from full path
+        size_t lastSlash = line.find_last_of("/\\");
+        string name = (lastSlash != string::npos) ? line.substr(lastSlash + 1) : line;
+        long row = database.find(name);
+        if (row < 0) {
+            cerr << "Error: Query image " << name << " not found in database!" << endl;
+            continue;
+        }
+        queryRows.push_back((size_t)row);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+// batch_search.h
+#ifndef BATCH_SEARCH_H
+#define BATCH_SEARCH_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include "thread_pool.h"
+
+class FeatureMatrix;
+
+/*
+ * SSD search for many queries at once. ||q - x||^2 is expanded to ||q||^2 + ||x||^2 - 2 q.x, and the dot
+ * products of a block of queries against a block of database rows come from one cv::gemm, so the scan runs
+ * at matrix-multiply speed instead of one distance at a time. The database norms are computed once, when
+ * the index is built, and reused by every search. The expansion cancels badly when the norms are large next
+ * to the distances, so it only shortlists: each query keeps k + max(k, 16) rows by the expanded distance,
+ * and those are re-scored with the direct SSD. The reported distances are the same as parallelSsdTopK's,
+ * and the k rows only differ from its when the expansion's error exceeds the gap to the shortlist's end.
+ */
+class SsdBatchIndex {
+public:
+    // The matrix is not copied and has to outlive the index
+    explicit SsdBatchIndex(const FeatureMatrix& database);
+
+    /*
+     * The k nearest database rows of every database row in queryRows, best first, as (SSD, row) with ties
+     * ordered by row; each query's own row is left out of its results. The queries are read in place, so a
+     * search over the whole database needs no copy of it. Query blocks run on the pool.
+     */
+    std::vector<std::vector<std::pair<float, size_t>>> search(WorkStealingPool& pool, const std::vector<size_t>& queryRows,
+                                                              size_t k) const;
+
+    const std::vector<float>& norms() const { return rowNorms; }
+
+private:
+    const FeatureMatrix& database;
+    std::vector<float> rowNorms; // ||x||^2 of every database row
+};
+
+/*
+ * Picks the queries of a batch search from database as row indices: the images named in queryList (one
+ * filename or path per line), or every row if queryList is "all". Names that are not in the database are
+ * reported and skipped. The function returns 0 on success and 1 if the list cannot be read.
+ */
+int readBatchQueries(const std::string& queryList, const FeatureMatrix& database, std::vector<size_t>& queryRows);
+
+
+#endif
@@ -5,146 +5,346 @@
 #include <string>
 #include "opencv2/opencv.hpp"
 #include "csv_utils.h"
-#include <cstdlib> // For atoi and atof
+#include <algorithm>
+#include <charconv>
+#include <thread>
+#include <system_error>
+#include "mapped_file.h"
+#include "feature_matrix.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 /*
- * reads a string from a CSV file. the 0-terminated string is returned in the char array os.
- * The function returns false if it is successfully read. It returns true if it reaches the end of the line or the file.
+ * Parses one float field in [p, end). Leading blanks and '+' are skipped like atof;
+ * an empty or malformed field reads as 0 (again like atof).
  */
-int getstring(FILE* fp, char os[]) {
-    int p = 0;
-    int eol = 0;
-
-    for (;;) {
-        char ch = fgetc(fp);
-        if (ch == ',') {
-            break;
-        }
-        else if (ch == '\n' || ch == EOF) {
-            eol = 1;
-            break;
-        }
-        os[p] = ch;
+static float parse_float_field(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '+')) {
         p++;
     }
-    os[p] = '\0';
-
-    return (eol); // return true if eol
+    float v = 0.0f;
+    if (std::from_chars(p, end, v).ec != std::errc()) {
+        v = 0.0f;
+    }
+    return v;
 }
 
-int getint(FILE* fp, int* v) {
-    char s[256];
-    int p = 0;
-    int eol = 0;
+/*
+ * Parses CSV text of the form filename,f0,f1,...\n and calls row(name, name_len, values, n) for every line.
+ * Like the original fgetc reader, parsing stops at the first line that has no ',' (e.g. a blank line).
+ * values is scratch storage owned by the parser and is only valid during the callback.
+ * Returns a pointer just past the last consumed line.
+ */
+template <typename RowFn>
+static const char* parse_csv_rows(const char* p, const char* end, std::vector<float>& values, RowFn row) {
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        const char* line_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
 
-    for (;;) {
-        char ch = fgetc(fp);
-        if (ch == ',') {
-            break;
+        const char* comma = (const char*)memchr(p, ',', line_end - p);
+        if (!comma) {
+            return p;
         }
-        else if (ch == '\n' || ch == EOF) {
-            eol = 1;
-            break;
+
+        values.clear();
+        const char* f = comma + 1;
+        for (;;) {
+            const char* next = (const char*)memchr(f, ',', line_end - f);
+            if (!next) next = line_end;
+            values.push_back(parse_float_field(f, next));
+            if (next == line_end) break;
+            f = next + 1;
         }
 
-        s[p] = ch;
-        p++;
+        if (!row(p, (size_t)(comma - p), values.data(), values.size())) {
+            return p;
+        }
+        p = eol < end ? eol + 1 : end;
     }
-    s[p] = '\0'; // terminator
-    *v = atoi(s);
+    return p;
+}
+
+CsvFeatureWriter::CsvFeatureWriter(size_t buffer_bytes) : fp(nullptr), buffer(buffer_bytes < 4096 ? 4096 : buffer_bytes), used(0) {
+}
 
-    return (eol); // return true if eol
+CsvFeatureWriter::~CsvFeatureWriter() {
+    close(0);
+}
+
+int CsvFeatureWriter::open(const char* filename, int reset_file) {
+    close(0);
+
+    fp = fopen(filename, reset_file ? "wb" : "ab");
+    if (!fp) {
+        perror("Unable to open output file");
+        return 1;
+    }
+    setvbuf(fp, NULL, _IONBF, 0); // we do our own buffering
+    used = 0;
+    return 0;
 }
 
 /*
- * Utility function for reading one float value from a CSV file
- * The value is stored in the v parameter
- * The function returns true if it reaches the end of a line or the file
+ * Appends one "filename,v0,v1,...\n" row. Values use the same fixed 4-decimal format as "%.4f".
+ * The function returns 0 on success and 1 on error.
  */
-int getfloat(FILE* fp, float* v) {
-    char s[256];
-    int p = 0;
-    int eol = 0;
-
-    for (;;) {
-        char ch = fgetc(fp);
-        if (ch == ',') {
-            break;
-        }
-        else if (ch == '\n' || ch == EOF) {
-            eol = 1;
-            break;
-        }
+int CsvFeatureWriter::append(const char* image_filename, const float* data, size_t n) {
+    if (!fp) {
+        fprintf(stderr, "CsvFeatureWriter: append on a closed writer\n");
+        return 1;
+    }
 
-        s[p] = ch;
-        p++;
+    // a float in fixed notation with 4 decimals needs at most 39 + 1 + 4 characters plus sign and ','
+    const size_t max_field = 48;
+    size_t name_len = strlen(image_filename);
+
+    if (buffer.size() - used < name_len + 1 && flush()) return 1;
+    if (buffer.size() - used < name_len + 1) {
+        buffer.resize(name_len + 1 + max_field);
+    }
+    memcpy(&buffer[used], image_filename, name_len);
+    used += name_len;
+
+    for (size_t i = 0; i < n; i++) {
+        if (buffer.size() - used < max_field && flush()) return 1;
+        char* p = &buffer[used];
+        *p++ = ',';
+        p = std::to_chars(p, buffer.data() + buffer.size(), data[i], std::chars_format::fixed, 4).ptr;
+        used = (size_t)(p - buffer.data());
     }
-    s[p] = '\0'; // terminator
-    *v = atof(s);
 
-    return (eol); // return true if eol
+    if (buffer.size() - used < 1 && flush()) return 1;
+    buffer[used++] = '\n';
+    return 0;
 }
 
+int CsvFeatureWriter::flush() {
+    if (!fp) return 1;
+    if (used > 0 && fwrite(buffer.data(), 1, used, fp) != used) {
+        perror("Unable to write output file");
+        return 1;
+    }
+    used = 0;
+    return 0;
+}
 
+/*
+ * Flushes pending rows and closes the file. With sync set the data is forced to disk first.
+ */
+int CsvFeatureWriter::close(int sync) {
+    if (!fp) return 0;
 
+    int err = flush();
+    if (sync && !err) {
+#ifdef _WIN32
+        err = _commit(_fileno(fp)) != 0;
+#else
+        err = fsync(fileno(fp)) != 0;
+#endif
+        if (err) perror("Unable to sync output file");
+    }
+    err |= fclose(fp) != 0;
+    fp = nullptr;
+    used = 0;
+    return err;
+}
+
+/*
+ * Appends a single row. For whole ingestion runs keep one CsvFeatureWriter open instead.
+ */
 int append_image_data_csv(const char* filename, const char* image_filename, std::vector<float>& image_data, int reset_file) {
-    char mode[8];
-    FILE* fp;
+    CsvFeatureWriter writer(4096 + image_data.size() * 16);
+
+    if (writer.open(filename, reset_file)) {
+        return 1; // Indicate error
+    }
+    int err = writer.append(image_filename, image_data.data(), image_data.size());
+    err |= writer.close(0);
+
+    return err;
+}
 
-    strcpy(mode, "a");
+// Rows parsed from one newline-aligned byte range by read_image_data_csv_parallel
+struct CsvChunk {
+    std::vector<std::string> filenames;
+    std::vector<float> data;
+    int dim = -1;
+    int err = 0;
+    bool stopped = false; // hit a line without ',' before the end of the range
+};
 
-    if (reset_file) {
-        strcpy(mode, "w");
+/*
+ * Splits the mapped file into newline-aligned byte ranges and parses them on num_threads threads
+ * (0 = one per core). The first used_chunks chunks hold the rows, in file order.
+ * The function returns 0 on success and 1 on error.
+ */
+static int parse_csv_chunks(const char* filename, std::vector<CsvChunk>& chunks, size_t& used_chunks, int& dim, int num_threads) {
+    MappedFile mf;
+    if (map_file_readonly(filename, mf)) {
+        return 1; // map_file_readonly reports the error
     }
 
-    fp = fopen(filename, mode);
-    if (!fp) {
-        perror("Unable to open output file"); // More robust error handling
-        return 1; // Indicate error
+    printf("Reading %s\n", filename);
+    const char* begin = mf.data;
+    const char* end = mf.data + mf.size;
+
+    // no point in waking threads for less than a few MB each
+    const size_t min_chunk_bytes = 4 << 20;
+    size_t nthreads = num_threads > 0 ? (size_t)num_threads : std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::max<size_t>(1, std::min(nthreads, mf.size / min_chunk_bytes + 1));
+
+    // chunk boundaries, each moved forward to just past the next newline
+    std::vector<const char*> bounds(nthreads + 1, end);
+    bounds[0] = begin;
+    for (size_t t = 1; t < nthreads; t++) {
+        const char* p = begin + mf.size / nthreads * t;
+        if (p < bounds[t - 1]) p = bounds[t - 1];
+        const char* nl = p < end ? (const char*)memchr(p, '\n', end - p) : nullptr;
+        bounds[t] = nl ? nl + 1 : end;
     }
 
-    fprintf(fp, "%s", image_filename);
-    for (size_t i = 0; i < image_data.size(); i++) {
-        fprintf(fp, ",%.4f", image_data[i]);
+    chunks.assign(nthreads, CsvChunk());
+    auto parse_chunk = [&](size_t t) {
+        CsvChunk& c = chunks[t];
+        size_t bytes = (size_t)(bounds[t + 1] - bounds[t]);
+        std::vector<float> values;
+        const char* stop = parse_csv_rows(bounds[t], bounds[t + 1], values, [&](const char* name, size_t name_len, const float* v, size_t n) {
+            if (c.dim < 0) {
+                c.dim = (int)n;
+                // rough row estimate from the first line of the chunk
+                size_t est_rows = bytes / (name_len + 1 + n * 7) + 1;
+                c.data.reserve(est_rows * n);
+                c.filenames.reserve(est_rows);
+            }
+            else if ((size_t)c.dim != n) {
+                c.err = 1;
+                return false;
+            }
+            c.filenames.emplace_back(name, name_len);
+            c.data.insert(c.data.end(), v, v + n);
+            return true;
+        });
+        c.stopped = stop != bounds[t + 1];
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < nthreads; t++) {
+        workers.emplace_back(parse_chunk, t);
+    }
+    parse_chunk(0);
+    for (auto& w : workers) {
+        w.join();
     }
 
-    fprintf(fp, "\n");
+    // like the serial reader, everything after the first line without ',' is ignored
+    used_chunks = 0;
+    while (used_chunks < nthreads && !chunks[used_chunks++].stopped) {}
 
-    fclose(fp);
+    dim = -1;
+    int err = 0;
+    for (size_t t = 0; t < used_chunks; t++) {
+        const CsvChunk& c = chunks[t];
+        if (c.err || (c.dim >= 0 && dim >= 0 && c.dim != dim)) {
+            err = 1;
+        }
+        if (c.dim >= 0 && dim < 0) dim = c.dim;
+    }
+    if (dim < 0) dim = 0;
 
+    unmap_file(mf);
+    if (err) {
+        fprintf(stderr, "Rows of %s do not all have the same number of values\n", filename);
+        return 1;
+    }
     return 0;
 }
 
-int read_image_data_csv(const char* filename, std::vector<std::string>& filenames, std::vector<std::vector<float>>& data, int echo_file) {
-    FILE* fp;
-    float fval;
-    char img_file[256];
-
-    fp = fopen(filename, "r");
-    if (!fp) {
-        perror("Unable to open feature file"); // More robust error handling
-        return 1; // Indicate error
+/*
+ * Reads a feature CSV into one row-major matrix: data holds filenames.size() * dim floats.
+ * All rows must have the same number of values. The mapped file is split into newline-aligned
+ * byte ranges that are parsed with std::from_chars on num_threads threads (0 = one per core). The
+ * per-thread rows are stitched back together in file order, so the result does not depend on the
+ * thread count.
+ * The function returns 0 on success and 1 on error.
+ */
+int read_image_data_csv_parallel(const char* filename, std::vector<std::string>& filenames, std::vector<float>& data, int& dim, int num_threads) {
+    std::vector<CsvChunk> chunks;
+    size_t used_chunks = 0;
+    if (parse_csv_chunks(filename, chunks, used_chunks, dim, num_threads)) {
+        return 1;
     }
 
-    printf("Reading %s\n", filename);
-    for (;;) {
-        std::vector<float> dvec;
+    size_t total_rows = 0;
+    for (size_t t = 0; t < used_chunks; t++) {
+        total_rows += chunks[t].filenames.size();
+    }
 
-        if (getstring(fp, img_file)) {
-            break;
+    filenames.reserve(filenames.size() + total_rows);
+    data.reserve(data.size() + total_rows * (size_t)dim);
+    for (size_t t = 0; t < used_chunks; t++) {
+        CsvChunk& c = chunks[t];
+        for (auto& name : c.filenames) {
+            filenames.push_back(std::move(name));
         }
+        data.insert(data.end(), c.data.begin(), c.data.end());
+        std::vector<float>().swap(c.data);
+    }
 
-        filenames.push_back(std::string(img_file));
+    printf("Finished reading CSV file\n");
+    return 0;
+}
 
-        for (;;) {
-            float eol = getfloat(fp, &fval);
-            dvec.push_back(fval);
-            if (eol) break;
+/*
+ * Reads a feature CSV into a FeatureMatrix, parsed on num_threads threads (0 = one per core) like
+ * read_image_data_csv_parallel; rows stay in file order. All rows must have the same number of values.
+ * The function returns 0 on success and 1 on error.
+ */
+int read_image_data_csv(const char* filename, FeatureMatrix& matrix, int num_threads) {
+    std::vector<CsvChunk> chunks;
+    size_t used_chunks = 0;
+    int dim = 0;
+    if (parse_csv_chunks(filename, chunks, used_chunks, dim, num_threads)) {
+        return 1;
+    }
+
+    size_t total_rows = 0;
+    for (size_t t = 0; t < used_chunks; t++) {
+        total_rows += chunks[t].filenames.size();
+    }
+
+    matrix.reset((size_t)dim);
+    matrix.reserve(total_rows);
+    for (size_t t = 0; t < used_chunks; t++) {
+        CsvChunk& c = chunks[t];
+        for (size_t r = 0; r < c.filenames.size(); r++) {
+            matrix.append(c.filenames[r], c.data.data() + r * (size_t)dim);
         }
+        std::vector<float>().swap(c.data);
+    }
+
+    printf("Finished reading CSV file\n");
+    return 0;
+}
 
-        data.push_back(dvec);
+int read_image_data_csv(const char* filename, std::vector<std::string>& filenames, std::vector<std::vector<float>>& data, int echo_file) {
+    MappedFile mf;
+    if (map_file_readonly(filename, mf)) {
+        return 1; // map_file_readonly reports the error
     }
-    fclose(fp);
+
+    printf("Reading %s\n", filename);
+    std::vector<float> values;
+    parse_csv_rows(mf.data, mf.data + mf.size, values, [&](const char* name, size_t name_len, const float* v, size_t n) {
+        filenames.emplace_back(name, name_len);
+        data.emplace_back(v, v + n);
+        return true;
+    });
+    unmap_file(mf);
     printf("Finished reading CSV file\n");
 
     if (echo_file) {
@@ -158,4 +358,4 @@ int read_image_data_csv(const char* filename, std::vector<std::string>& filename
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -2,11 +2,40 @@
 #ifndef CSV_UTIL_H
 #define CSV_UTIL_H
 
+#include <cstdio>
 #include <vector>
 #include <string>
 
+class FeatureMatrix;
+
+/*
+ * Buffered CSV writer that stays open across a whole ingestion run.
+ * Values are formatted with std::to_chars ("%.4f" equivalent) into a large buffer that is
+ * flushed in big writes; close() fsyncs the file once at the end.
+ */
+class CsvFeatureWriter {
+public:
+    explicit CsvFeatureWriter(size_t buffer_bytes = 1 << 20);
+    ~CsvFeatureWriter();
+
+    int open(const char* filename, int reset_file = 0);
+    int append(const char* image_filename, const float* data, size_t n);
+    int flush();
+    int close(int sync = 1);
+
+private:
+    CsvFeatureWriter(const CsvFeatureWriter&) = delete;
+    CsvFeatureWriter& operator=(const CsvFeatureWriter&) = delete;
+
+    FILE* fp;
+    std::vector<char> buffer;
+    size_t used;
+};
+
 int append_image_data_csv(const char* filename, const char* image_filename, std::vector<float>& image_data, int reset_file = 0);
 int read_image_data_csv(const char* filename, std::vector<std::string>& filenames, std::vector<std::vector<float>>& data, int echo_file = 0);
+int read_image_data_csv_parallel(const char* filename, std::vector<std::string>& filenames, std::vector<float>& data, int& dim, int num_threads = 0);
+int read_image_data_csv(const char* filename, FeatureMatrix& matrix, int num_threads = 0);
 
 
 #endif
@@ -0,0 +1,280 @@
+// distance_kernels.cpp
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "distance_kernels.h"
+#include "simd_target.h"
+
+typedef float (*DistanceFn)(const float*, const float*, size_t);
+
+struct DistanceKernels {
+    DistanceFn ssd;
+    DistanceFn l1;
+    DistanceFn intersection;
+    DistanceFn dot;
+    const char* isa;
+};
+
+// Per-element terms, shared by the scalar loops and the vector tails
+static inline float ssdTerm(float x, float y) { return (x - y) * (x - y); }
+static inline float l1Term(float x, float y) { return fabsf(x - y); }
+static inline float intersectionTerm(float x, float y) { return x < y ? x : y; }
+static inline float dotTerm(float x, float y) { return x * y; }
+
+template <float (*Term)(float, float)>
+static float reduceScalar(const float* a, const float* b, size_t n)
+{
+    float sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += Term(a[i], b[i]);
+    }
+    return sum;
+}
+
+#ifdef SIMD_X86
+
+// SSE4.1: four partial sums of 4 floats
+
+TARGET("sse4.1") static inline __m128 ssdStep128(__m128 acc, __m128 x, __m128 y)
+{
+    __m128 d = _mm_sub_ps(x, y);
+    return _mm_add_ps(acc, _mm_mul_ps(d, d));
+}
+TARGET("sse4.1") static inline __m128 l1Step128(__m128 acc, __m128 x, __m128 y)
+{
+    return _mm_add_ps(acc, _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(x, y)));
+}
+TARGET("sse4.1") static inline __m128 intersectionStep128(__m128 acc, __m128 x, __m128 y)
+{
+    return _mm_add_ps(acc, _mm_min_ps(x, y));
+}
+TARGET("sse4.1") static inline __m128 dotStep128(__m128 acc, __m128 x, __m128 y)
+{
+    return _mm_add_ps(acc, _mm_mul_ps(x, y));
+}
+
+template <__m128 (*Step)(__m128, __m128, __m128), float (*Term)(float, float)>
+TARGET("sse4.1") static float reduceSse41(const float* a, const float* b, size_t n)
+{
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps(), acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = Step(acc0, _mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        acc1 = Step(acc1, _mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc2 = Step(acc2, _mm_loadu_ps(a + i + 8), _mm_loadu_ps(b + i + 8));
+        acc3 = Step(acc3, _mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = Step(acc0, _mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    }
+
+    __m128 acc = _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    float sum = _mm_cvtss_f32(acc);
+    for (; i < n; i++) {
+        sum += Term(a[i], b[i]);
+    }
+    return sum;
+}
+
+// AVX2 + FMA: four partial sums of 8 floats
+
+TARGET("avx2,fma") static inline __m256 ssdStep256(__m256 acc, __m256 x, __m256 y)
+{
+    __m256 d = _mm256_sub_ps(x, y);
+    return _mm256_fmadd_ps(d, d, acc);
+}
+TARGET("avx2,fma") static inline __m256 l1Step256(__m256 acc, __m256 x, __m256 y)
+{
+    return _mm256_add_ps(acc, _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(x, y)));
+}
+TARGET("avx2,fma") static inline __m256 intersectionStep256(__m256 acc, __m256 x, __m256 y)
+{
+    return _mm256_add_ps(acc, _mm256_min_ps(x, y));
+}
+TARGET("avx2,fma") static inline __m256 dotStep256(__m256 acc, __m256 x, __m256 y)
+{
+    return _mm256_fmadd_ps(x, y, acc);
+}
+
+template <__m256 (*Step)(__m256, __m256, __m256), float (*Term)(float, float)>
+TARGET("avx2,fma") static float reduceAvx2(const float* a, const float* b, size_t n)
+{
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = Step(acc0, _mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc1 = Step(acc1, _mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc2 = Step(acc2, _mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        acc3 = Step(acc3, _mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = Step(acc0, _mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    }
+
+    __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    float sum = _mm_cvtss_f32(half);
+    for (; i < n; i++) {
+        sum += Term(a[i], b[i]);
+    }
+    return sum;
+}
+
+// GCC 12's avx512fintrin.h seeds results with self-initialized _mm512_undefined_* values, which -Wall
+// reports once the intrinsics are inlined into target("avx512f") functions
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+// AVX-512: two partial sums of 16 floats; the tail is a masked load, zeros add nothing for any of the terms
+
+TARGET("avx512f") static inline __m512 ssdStep512(__m512 acc, __m512 x, __m512 y)
+{
+    __m512 d = _mm512_sub_ps(x, y);
+    return _mm512_fmadd_ps(d, d, acc);
+}
+TARGET("avx512f") static inline __m512 l1Step512(__m512 acc, __m512 x, __m512 y)
+{
+    return _mm512_add_ps(acc, _mm512_abs_ps(_mm512_sub_ps(x, y)));
+}
+TARGET("avx512f") static inline __m512 intersectionStep512(__m512 acc, __m512 x, __m512 y)
+{
+    return _mm512_add_ps(acc, _mm512_min_ps(x, y));
+}
+TARGET("avx512f") static inline __m512 dotStep512(__m512 acc, __m512 x, __m512 y)
+{
+    return _mm512_fmadd_ps(x, y, acc);
+}
+
+template <__m512 (*Step)(__m512, __m512, __m512)>
+TARGET("avx512f") static float reduceAvx512(const float* a, const float* b, size_t n)
+{
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = Step(acc0, _mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc1 = Step(acc1, _mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = Step(acc0, _mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    }
+    if (i < n) {
+        __mmask16 tail = (__mmask16)((1u << (n - i)) - 1);
+        acc1 = Step(acc1, _mm512_maskz_loadu_ps(tail, a + i), _mm512_maskz_loadu_ps(tail, b + i));
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+enum { ISA_SCALAR, ISA_SSE41, ISA_AVX2, ISA_AVX512 };
+
+static int detectIsa()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    int leaf7 = 0;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        leaf7 = info[1];
+    }
+
+    // the OS has to save the YMM (and ZMM) state as well
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    if ((xcr0 & 0xe6) == 0xe6 && (leaf7 & (1 << 16))) return ISA_AVX512;
+    if ((xcr0 & 0x6) == 0x6 && fma && (leaf7 & (1 << 5))) return ISA_AVX2;
+    return sse41 ? ISA_SSE41 : ISA_SCALAR;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return ISA_AVX2;
+    return __builtin_cpu_supports("sse4.1") ? ISA_SSE41 : ISA_SCALAR;
+#endif
+}
+
+#endif  // SIMD_X86
+
+static DistanceKernels selectKernels()
+{
+    DistanceKernels k = { reduceScalar<ssdTerm>, reduceScalar<l1Term>, reduceScalar<intersectionTerm>,
+                          reduceScalar<dotTerm>, "scalar" };
+
+#ifdef SIMD_X86
+    int isa = detectIsa();
+    const char* cap = getenv("CBIR_SIMD");
+    if (cap && *cap) {
+        int limit = !strcmp(cap, "scalar") ? ISA_SCALAR
+                  : !strcmp(cap, "sse4.1") ? ISA_SSE41
+                  : !strcmp(cap, "avx2")   ? ISA_AVX2
+                                           : ISA_AVX512;  // unknown values do not cap
+        if (limit < isa) isa = limit;
+    }
+
+    if (isa == ISA_AVX512) {
+        k = { reduceAvx512<ssdStep512>, reduceAvx512<l1Step512>, reduceAvx512<intersectionStep512>,
+              reduceAvx512<dotStep512>, "avx512" };
+    }
+    else if (isa == ISA_AVX2) {
+        k = { reduceAvx2<ssdStep256, ssdTerm>, reduceAvx2<l1Step256, l1Term>,
+              reduceAvx2<intersectionStep256, intersectionTerm>, reduceAvx2<dotStep256, dotTerm>, "avx2" };
+    }
+    else if (isa == ISA_SSE41) {
+        k = { reduceSse41<ssdStep128, ssdTerm>, reduceSse41<l1Step128, l1Term>,
+              reduceSse41<intersectionStep128, intersectionTerm>, reduceSse41<dotStep128, dotTerm>, "sse4.1" };
+    }
+#endif
+    return k;
+}
+
+// chosen once while the program starts; nothing calls the kernels from static initializers
+static const DistanceKernels g_kernels = selectKernels();
+
+float ssdDistance(const float* a, const float* b, size_t n)
+{
+    return g_kernels.ssd(a, b, n);
+}
+
+float ssdDistanceBounded(const float* a, const float* b, size_t n, float bound)
+{
+    const size_t CHUNK = 128;  // long enough for the vector loops, short enough to stop early
+    float sum = 0;
+    for (size_t i = 0; i < n && !(sum > bound); i += CHUNK) {
+        sum += g_kernels.ssd(a + i, b + i, n - i < CHUNK ? n - i : CHUNK);
+    }
+    return sum;
+}
+
+float l1Distance(const float* a, const float* b, size_t n)
+{
+    return g_kernels.l1(a, b, n);
+}
+
+float intersectionSimilarity(const float* a, const float* b, size_t n)
+{
+    return g_kernels.intersection(a, b, n);
+}
+
+float dotProduct(const float* a, const float* b, size_t n)
+{
+    return g_kernels.dot(a, b, n);
+}
+
+const char* distanceKernelIsa()
+{
+    return g_kernels.isa;
+}
@@ -0,0 +1,34 @@
+// distance_kernels.h
+#ifndef DISTANCE_KERNELS_H
+#define DISTANCE_KERNELS_H
+
+#include <cstddef>
+
+/*
+ * Distance and similarity kernels shared by all the matchers. Each has AVX-512, AVX2 (+FMA), SSE4.1 and
+ * scalar versions; the widest one the CPU supports (CPUID) is picked once at startup, so the binary does not
+ * need to be built with -mavx2 to get them. Setting CBIR_SIMD to scalar, sse4.1, avx2 or avx512 caps the
+ * choice (unknown values are ignored), which is handy for comparing scores across machines. The vector
+ * versions keep several partial sums, so results can differ from a sequential float loop in the last bits.
+ */
+
+// Sum of squared differences
+float ssdDistance(const float* a, const float* b, size_t n);
+
+// Sum of absolute differences
+float l1Distance(const float* a, const float* b, size_t n);
+
+// Histogram intersection, sum of min(a[i], b[i]); higher means more similar
+float intersectionSimilarity(const float* a, const float* b, size_t n);
+
+float dotProduct(const float* a, const float* b, size_t n);
+
+// SSD summed in fixed chunks that stops once the partial sum exceeds bound (early abandoning); the result
+// is then some value > bound. Results that stay within bound do not depend on it.
+float ssdDistanceBounded(const float* a, const float* b, size_t n, float bound);
+
+// "avx512", "avx2", "sse4.1" or "scalar"
+const char* distanceKernelIsa();
+
+
+#endif
@@ -0,0 +1,118 @@
+// feature_matrix.cpp
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "feature_matrix.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static float* alloc_aligned(size_t floats) {
+    size_t bytes = (std::max<size_t>(floats * sizeof(float), 1) + FeatureMatrix::ALIGNMENT - 1) /
+                   FeatureMatrix::ALIGNMENT * FeatureMatrix::ALIGNMENT;
+#ifdef _WIN32
+    void* p = _aligned_malloc(bytes, FeatureMatrix::ALIGNMENT);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, FeatureMatrix::ALIGNMENT, bytes) != 0) {
+        p = nullptr;
+    }
+#endif
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return (float*)p;
+}
+
+static void free_aligned(float* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+FeatureMatrix::FeatureMatrix() : buffer(nullptr), capacity(0), cols(0), step(0) {
+}
+
+FeatureMatrix::FeatureMatrix(size_t dim) : FeatureMatrix() {
+    reset(dim);
+}
+
+FeatureMatrix::~FeatureMatrix() {
+    free_aligned(buffer);
+}
+
+FeatureMatrix::FeatureMatrix(FeatureMatrix&& other) noexcept
+    : buffer(other.buffer), capacity(other.capacity), cols(other.cols), step(other.step), names(std::move(other.names)) {
+    other.buffer = nullptr;
+    other.capacity = 0;
+    other.names.clear();
+}
+
+FeatureMatrix& FeatureMatrix::operator=(FeatureMatrix&& other) noexcept {
+    if (this != &other) {
+        free_aligned(buffer);
+        buffer = other.buffer;
+        capacity = other.capacity;
+        cols = other.cols;
+        step = other.step;
+        names = std::move(other.names);
+        other.buffer = nullptr;
+        other.capacity = 0;
+        other.names.clear();
+    }
+    return *this;
+}
+
+void FeatureMatrix::reset(size_t dim) {
+    const size_t line = ALIGNMENT / sizeof(float);
+    size_t new_step = (dim + line - 1) / line * line;
+
+    // the same bytes hold fewer or more rows at the new stride
+    capacity = step > 0 ? capacity * step / std::max<size_t>(new_step, 1) : 0;
+    if (new_step == 0) capacity = 0;
+    cols = dim;
+    step = new_step;
+    names.clear();
+}
+
+void FeatureMatrix::reserve(size_t new_rows) {
+    if (new_rows <= capacity || step == 0) {
+        return;
+    }
+    float* grown = alloc_aligned(new_rows * step);
+    if (buffer) {
+        memcpy(grown, buffer, rows() * step * sizeof(float));
+    }
+    free_aligned(buffer);
+    buffer = grown;
+    capacity = new_rows;
+}
+
+float* FeatureMatrix::append(const std::string& filename) {
+    if (rows() == capacity) {
+        reserve(std::max<size_t>(16, capacity * 2));
+    }
+    names.push_back(filename);
+
+    float* r = row(rows() - 1);
+    std::fill(r, r + step, 0.0f);
+    return r;
+}
+
+void FeatureMatrix::append(const std::string& filename, const float* values) {
+    float* r = append(filename);
+    std::copy(values, values + cols, r);
+}
+
+long FeatureMatrix::find(const std::string& image_filename) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == image_filename) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
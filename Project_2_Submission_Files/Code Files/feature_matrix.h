@@ -0,0 +1,62 @@
+// feature_matrix.h
+#ifndef FEATURE_MATRIX_H
+#define FEATURE_MATRIX_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * The feature vectors of a whole database in one row-major buffer, instead of one heap vector per image,
+ * so a scan reads memory front to back and the hardware prefetcher can run ahead of it. The buffer is
+ * 64-byte aligned and rows are stride() floats apart, stride() being dim() rounded up to a whole cache
+ * line; the padding is kept at zero, so kernels may also run over it. Row i belongs to filename(i).
+ */
+class FeatureMatrix {
+public:
+    static const size_t ALIGNMENT = 64;
+
+    FeatureMatrix();
+    explicit FeatureMatrix(size_t dim);
+    ~FeatureMatrix();
+
+    FeatureMatrix(FeatureMatrix&& other) noexcept;
+    FeatureMatrix& operator=(FeatureMatrix&& other) noexcept;
+
+    // Drops all rows and sets the row length; the allocation is kept for reuse
+    void reset(size_t dim);
+    void reserve(size_t rows);
+
+    // Appends a zeroed row for filename and returns it, for extractors that write in place
+    float* append(const std::string& filename);
+    // Appends a copy of dim() values
+    void append(const std::string& filename, const float* values);
+
+    size_t rows() const { return names.size(); }
+    size_t dim() const { return cols; }
+    size_t stride() const { return step; }
+    bool empty() const { return names.empty(); }
+
+    float* row(size_t i) { return buffer + i * step; }
+    const float* row(size_t i) const { return buffer + i * step; }
+    const float* data() const { return buffer; }
+
+    const std::string& filename(size_t i) const { return names[i]; }
+    const std::vector<std::string>& filenames() const { return names; }
+
+    // Row of image_filename, or -1 if it is not present
+    long find(const std::string& image_filename) const;
+
+private:
+    FeatureMatrix(const FeatureMatrix&) = delete;
+    FeatureMatrix& operator=(const FeatureMatrix&) = delete;
+
+    float* buffer;
+    size_t capacity; // rows the buffer has room for
+    size_t cols;
+    size_t step;
+    std::vector<std::string> names;
+};
+
+
+#endif
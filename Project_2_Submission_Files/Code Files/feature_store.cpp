@@ -0,0 +1,291 @@
+// feature_store.cpp
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+#include "feature_store.h"
+#include "csv_utils.h"
+#include "feature_matrix.h"
+
+static const uint64_t STORE_ALIGNMENT = 64;
+
+static void init_header(FeatureStoreHeader& header, uint64_t rows, uint64_t dim) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FEATURE_STORE_MAGIC, sizeof(FEATURE_STORE_MAGIC));
+    header.version = FEATURE_STORE_VERSION;
+    header.dtype = FEATURE_DTYPE_F32;
+    header.rows = rows;
+    header.dim = dim;
+    header.data_offset = align_up(sizeof(header), STORE_ALIGNMENT);
+    header.names_offset = align_up(header.data_offset + rows * dim * sizeof(float), sizeof(uint64_t));
+}
+
+// Writes the name offset table and the 0-terminated names; returns the size of the names
+static int write_names(FILE* fp, const std::vector<std::string>& filenames, uint64_t& names_bytes) {
+    std::vector<uint64_t> name_offsets(filenames.size() + 1);
+    names_bytes = 0;
+    for (size_t i = 0; i < filenames.size(); i++) {
+        name_offsets[i] = names_bytes;
+        names_bytes += filenames[i].size() + 1;
+    }
+    name_offsets[filenames.size()] = names_bytes;
+
+    int err = fwrite(name_offsets.data(), sizeof(uint64_t), name_offsets.size(), fp) != name_offsets.size();
+    for (size_t i = 0; i < filenames.size(); i++) {
+        err |= fwrite(filenames[i].c_str(), 1, filenames[i].size() + 1, fp) != filenames[i].size() + 1;
+    }
+    return err;
+}
+
+// Pads to 8 bytes after the names and writes the per-row decode scales; sets header.scales_offset
+static int write_scales(FILE* fp, FeatureStoreHeader& header, const uint8_t* scales) {
+    uint64_t names_end = header.names_offset + (header.rows + 1) * sizeof(uint64_t) + header.names_bytes;
+    header.scales_offset = align_up(names_end, sizeof(uint64_t));
+
+    int err = write_padding(fp, names_end, header.scales_offset);
+    if (header.rows > 0) {
+        err |= fwrite(scales, 1, (size_t)header.rows, fp) != header.rows;
+    }
+    return err;
+}
+
+// Writes rows = filenames.size() rows of dim floats, row i at data + i * stride
+static int write_feature_store_rows(const char* filename, const std::vector<std::string>& filenames, const float* data,
+                                    size_t dim, size_t stride, const uint8_t* scales) {
+    FeatureStoreHeader header;
+    init_header(header, filenames.size(), dim);
+    uint64_t data_bytes = header.rows * header.dim * sizeof(float);
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("Unable to open feature store for writing");
+        return 1;
+    }
+
+    int err = 0;
+    err |= fwrite(&header, sizeof(header), 1, fp) != 1; // names_bytes is patched in below
+    err |= write_padding(fp, sizeof(header), header.data_offset);
+    if (data_bytes > 0 && stride == dim) {
+        err |= fwrite(data, 1, (size_t)data_bytes, fp) != data_bytes;
+    }
+    else if (data_bytes > 0) {
+        for (size_t i = 0; i < filenames.size(); i++) {
+            err |= fwrite(data + i * stride, sizeof(float), dim, fp) != dim;
+        }
+    }
+    err |= write_padding(fp, header.data_offset + data_bytes, header.names_offset);
+    err |= write_names(fp, filenames, header.names_bytes);
+    if (scales) {
+        err |= write_scales(fp, header, scales);
+    }
+    err |= fseek(fp, 0, SEEK_SET) != 0;
+    err |= fwrite(&header, sizeof(header), 1, fp) != 1;
+    err |= fclose(fp) != 0;
+
+    if (err) {
+        fprintf(stderr, "Error writing feature store %s\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Writes rows = filenames.size() feature vectors of length dim to a binary feature store.
+ * data must hold rows * dim floats in row-major order; scales (optional) holds one decode scale per row.
+ * The function returns 0 on success and 1 on error.
+ */
+int write_feature_store(const char* filename, const std::vector<std::string>& filenames, const float* data, size_t dim,
+                        const uint8_t* scales) {
+    return write_feature_store_rows(filename, filenames, data, dim, dim, scales);
+}
+
+/*
+ * Writes the rows of a FeatureMatrix (without their padding) and its filenames to a binary feature store.
+ * The function returns 0 on success and 1 on error.
+ */
+int write_feature_store(const char* filename, const FeatureMatrix& matrix, const uint8_t* scales) {
+    return write_feature_store_rows(filename, matrix.filenames(), matrix.data(), matrix.dim(), matrix.stride(), scales);
+}
+
+FeatureStoreWriter::FeatureStoreWriter() : fp(nullptr), dim(0), err(0) {
+}
+
+FeatureStoreWriter::~FeatureStoreWriter() {
+    close();
+}
+
+int FeatureStoreWriter::open(const char* filename, size_t row_dim) {
+    close();
+
+    fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("Unable to open feature store for writing");
+        return 1;
+    }
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    dim = row_dim;
+    err = 0;
+    filenames.clear();
+    scales.clear();
+
+    // placeholder header, rewritten by close()
+    FeatureStoreHeader header;
+    init_header(header, 0, dim);
+    err |= fwrite(&header, sizeof(header), 1, fp) != 1;
+    err |= write_padding(fp, sizeof(header), header.data_offset);
+    return err;
+}
+
+int FeatureStoreWriter::append(const std::string& image_filename, const float* row, int decode_scale) {
+    if (!fp) return 1;
+    if (dim > 0) {
+        err |= fwrite(row, sizeof(float), dim, fp) != dim;
+    }
+    filenames.push_back(image_filename);
+    scales.push_back((uint8_t)decode_scale);
+    return err;
+}
+
+int FeatureStoreWriter::close() {
+    if (!fp) return 0;
+
+    FeatureStoreHeader header;
+    init_header(header, filenames.size(), dim);
+    uint64_t data_end = header.data_offset + header.rows * header.dim * sizeof(float);
+
+    err |= write_padding(fp, data_end, header.names_offset);
+    err |= write_names(fp, filenames, header.names_bytes);
+    err |= write_scales(fp, header, scales.data());
+    err |= fseek(fp, 0, SEEK_SET) != 0;
+    err |= fwrite(&header, sizeof(header), 1, fp) != 1;
+    err |= fclose(fp) != 0;
+    fp = nullptr;
+
+    if (err) {
+        fprintf(stderr, "Error writing feature store\n");
+    }
+    return err;
+}
+
+/*
+ * Maps a feature store and validates its header. Rows are served directly from the mapped pages.
+ * The function returns 0 on success and 1 on error.
+ */
+int open_feature_store(const char* filename, FeatureStore& store) {
+    store = FeatureStore();
+    if (map_file_readonly(filename, store.file)) {
+        return 1;
+    }
+
+    const MappedFile& mf = store.file;
+    FeatureStoreHeader header;
+    if (mf.size < sizeof(header)) {
+        fprintf(stderr, "Feature store %s is truncated\n", filename);
+        close_feature_store(store);
+        return 1;
+    }
+    memcpy(&header, mf.data, sizeof(header));
+
+    if (memcmp(header.magic, FEATURE_STORE_MAGIC, sizeof(FEATURE_STORE_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a feature store\n", filename);
+        close_feature_store(store);
+        return 1;
+    }
+    if (header.version < 1 || header.version > FEATURE_STORE_VERSION || header.dtype != FEATURE_DTYPE_F32) {
+        fprintf(stderr, "Unsupported feature store version %u / dtype %u in %s\n", header.version, header.dtype, filename);
+        close_feature_store(store);
+        return 1;
+    }
+
+    // every size is checked against the file before it is multiplied or added, so nothing can wrap around
+    const uint64_t size = mf.size;
+    bool ok = header.data_offset % STORE_ALIGNMENT == 0 && header.data_offset <= size &&
+              (header.dim == 0 || header.rows <= (size - header.data_offset) / sizeof(float) / header.dim) &&
+              header.rows < size / sizeof(uint64_t) && header.names_offset % sizeof(uint64_t) == 0 &&
+              header.data_offset + header.rows * header.dim * sizeof(float) <= header.names_offset &&
+              header.names_offset <= size && (header.rows + 1) * sizeof(uint64_t) <= size - header.names_offset &&
+              header.names_bytes <= size - header.names_offset - (header.rows + 1) * sizeof(uint64_t);
+    uint64_t offsets_bytes = (header.rows + 1) * sizeof(uint64_t);
+
+    // name offsets have to increase (every name has its terminator) and stay inside the names, which end in 0
+    if (ok) {
+        const uint64_t* offsets = (const uint64_t*)(mf.data + header.names_offset);
+        const char* names = mf.data + header.names_offset + offsets_bytes;
+        ok = offsets[header.rows] <= header.names_bytes &&
+             (header.rows == 0 || (offsets[header.rows] > 0 && names[offsets[header.rows] - 1] == '\0'));
+        for (uint64_t i = 0; ok && i < header.rows; i++) {
+            ok = offsets[i] < offsets[i + 1];
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Feature store %s is corrupt\n", filename);
+        close_feature_store(store);
+        return 1;
+    }
+
+    store.rows = (size_t)header.rows;
+    store.dim = (size_t)header.dim;
+    store.data = (const float*)(mf.data + header.data_offset);
+    store.name_offsets = (const uint64_t*)(mf.data + header.names_offset);
+    store.names = mf.data + header.names_offset + offsets_bytes;
+
+    // version 1 headers end before scales_offset; the bytes read there are data_offset padding (zero)
+    if (header.version >= 2 && header.scales_offset != 0) {
+        if (header.scales_offset > mf.size || header.rows > mf.size - header.scales_offset) {
+            fprintf(stderr, "Feature store %s is corrupt\n", filename);
+            close_feature_store(store);
+            return 1;
+        }
+        store.scales = (const uint8_t*)(mf.data + header.scales_offset);
+    }
+    return 0;
+}
+
+void close_feature_store(FeatureStore& store) {
+    unmap_file(store.file);
+    store = FeatureStore();
+}
+
+/*
+ * Returns the row index of image_filename in the store, or -1 if it is not present.
+ */
+long find_feature_store_row(const FeatureStore& store, const char* image_filename) {
+    for (size_t i = 0; i < store.rows; i++) {
+        if (strcmp(store.filename(i), image_filename) == 0) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Copies every row of an opened store, with its filename, into matrix (which is reset to store.dim).
+ */
+void read_feature_store_matrix(const FeatureStore& store, FeatureMatrix& matrix) {
+    matrix.reset(store.dim);
+    matrix.reserve(store.rows);
+    for (size_t i = 0; i < store.rows; i++) {
+        matrix.append(store.filename(i), store.row(i));
+    }
+}
+
+/*
+ * Converts a feature CSV (filename,f0,f1,...) into a binary feature store.
+ * All rows must have the same number of values.
+ */
+int convert_csv_to_feature_store(const char* csv_filename, const char* store_filename) {
+    std::vector<std::string> filenames;
+    std::vector<float> matrix;
+    int dim = 0;
+
+    if (read_image_data_csv_parallel(csv_filename, filenames, matrix, dim)) {
+        return 1;
+    }
+
+    if (write_feature_store(store_filename, filenames, matrix.data(), (size_t)dim)) {
+        return 1;
+    }
+    printf("Wrote %zu rows x %d values to %s\n", filenames.size(), dim, store_filename);
+    return 0;
+}
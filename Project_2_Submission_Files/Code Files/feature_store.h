@@ -0,0 +1,97 @@
+// feature_store.h
+#ifndef FEATURE_STORE_H
+#define FEATURE_STORE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include "mapped_file.h"
+
+class FeatureMatrix;
+
+/*
+ * Binary feature store (.fst), written in native (little-endian) byte order:
+ *
+ *   FeatureStoreHeader
+ *   float data[rows][dim]          row-major, starts at data_offset (64-byte aligned)
+ *   uint64_t name_offsets[rows+1]  starts at names_offset, offsets are relative to the string bytes
+ *   char names[]                   0-terminated filenames, directly after the offsets
+ *   uint8_t scales[rows]           version 2: optional, at scales_offset (8-byte aligned); the
+ *                                  1/scale decode resolution each row was extracted at
+ *
+ * Version 1 stores (no scales_offset field) are still readable; every row reads as scale 1.
+ */
+#define FEATURE_STORE_MAGIC "CBIRFST"
+#define FEATURE_STORE_VERSION 2
+
+enum FeatureDType {
+    FEATURE_DTYPE_F32 = 1
+};
+
+struct FeatureStoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint64_t rows;
+    uint64_t dim;
+    uint64_t data_offset;
+    uint64_t names_offset;
+    uint64_t names_bytes;
+    uint64_t scales_offset; // 0 if the store has no scales section
+};
+
+// An opened store; data and names point straight into the mapped file
+struct FeatureStore {
+    MappedFile file;
+    size_t rows = 0;
+    size_t dim = 0;
+    const float* data = nullptr;
+    const uint64_t* name_offsets = nullptr;
+    const char* names = nullptr;
+    const uint8_t* scales = nullptr;
+
+    const float* row(size_t i) const { return data + i * dim; }
+    const char* filename(size_t i) const { return names + name_offsets[i]; }
+    int decode_scale(size_t i) const { return scales ? scales[i] : 1; }
+};
+
+/*
+ * Streams rows into a feature store without holding the matrix in memory. The header is
+ * rewritten with the final row count when the writer is closed.
+ */
+class FeatureStoreWriter {
+public:
+    FeatureStoreWriter();
+    ~FeatureStoreWriter();
+
+    int open(const char* filename, size_t dim);
+    int append(const std::string& image_filename, const float* row, int decode_scale = 1);
+    int close();
+
+    size_t rows() const { return filenames.size(); }
+
+private:
+    FeatureStoreWriter(const FeatureStoreWriter&) = delete;
+    FeatureStoreWriter& operator=(const FeatureStoreWriter&) = delete;
+
+    FILE* fp;
+    size_t dim;
+    int err;
+    std::vector<std::string> filenames;
+    std::vector<uint8_t> scales;
+};
+
+int write_feature_store(const char* filename, const std::vector<std::string>& filenames, const float* data, size_t dim,
+                        const uint8_t* scales = nullptr);
+int write_feature_store(const char* filename, const FeatureMatrix& matrix, const uint8_t* scales = nullptr);
+int open_feature_store(const char* filename, FeatureStore& store);
+void close_feature_store(FeatureStore& store);
+long find_feature_store_row(const FeatureStore& store, const char* image_filename);
+void read_feature_store_matrix(const FeatureStore& store, FeatureMatrix& matrix);
+
+int convert_csv_to_feature_store(const char* csv_filename, const char* store_filename);
+
+
+#endif
@@ -0,0 +1,114 @@
+// fused_features.cpp
+#include <cstdint>
+#include "fused_features.h"
+#include "histogram_kernels.h"
+
+using namespace cv;
+using namespace std;
+
+static const int RG_BINS = 16;                        // computeHistogram default
+static const int RGB_BINS = 8;                        // computeRegionHistogram default
+static const int HSV_BINS = HsvBinCounter::H_BINS * HsvBinCounter::S_BINS * HsvBinCounter::V_BINS;  // getColorHistogram
+static const int TEXTURE_BINS = 256;                  // getTextureHistogram
+static const int GRAY_SHIFT = 15;
+
+int computeFusedFeatures(const Mat& image, FusedFeatures& features, int mask)
+{
+    if (image.empty() || image.type() != CV_8UC3) return 1;
+
+    const int rows = image.rows, cols = image.cols;
+    const bool doRg = (mask & FUSED_RG_CHROMATICITY) != 0;
+    const bool doUpper = (mask & FUSED_RGB_UPPER) != 0;
+    const bool doLower = (mask & FUSED_RGB_LOWER) != 0;
+    const bool doHsv = (mask & FUSED_HSV_COLOR) != 0;
+    const bool doTexture = (mask & FUSED_SOBEL_TEXTURE) != 0;
+
+    RgChromaticityCounter rgCounter(RG_BINS);
+    vector<uint32_t> upperCounts(doUpper ? RGB_BINS * RGB_BINS * RGB_BINS : 0);
+    vector<uint32_t> lowerCounts(doLower ? RGB_BINS * RGB_BINS * RGB_BINS : 0);
+    HsvBinCounter hsvCounter;
+    SobelMagnitudeCounter texture(doTexture ? rows : 0, doTexture ? cols : 0);
+
+    // upperRegion / lowerRegion
+    const Rect upper = upperRegion(image);
+    const Rect lower = lowerRegion(image);
+
+    for (int y = 0; y < rows; y++) {
+        const uchar* p = image.ptr<uchar>(y);
+        const bool inUpper = doUpper && y >= upper.y && y < upper.y + upper.height;
+        const bool inLower = doLower && y >= lower.y && y < lower.y + lower.height;
+        uchar* gray = doTexture ? texture.nextRow() : nullptr;
+
+        if (doRg) {
+            rgCounter.addRow(p, cols);  // vectorized; the row is still in L1 for the loop below
+        }
+        if (doHsv) {
+            hsvCounter.addRow(p, cols);
+        }
+
+        for (int x = 0; x < cols; x++, p += 3) {
+            const int b = p[0], g = p[1], r = p[2];
+
+            if (inUpper || inLower) {
+                int bin = ((b >> 5) * RGB_BINS + (g >> 5)) * RGB_BINS + (r >> 5);
+                if (inUpper) upperCounts[bin]++;
+                if (inLower) lowerCounts[bin]++;
+            }
+
+            if (doTexture) {
+                gray[x] = (uchar)((b * 3735 + g * 19235 + r * 9798 + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT);
+            }
+        }
+
+        if (doTexture) {
+            texture.commitRow();  // runs the Sobel stencil of the previous row
+        }
+    }
+
+    if (doRg) {
+        vector<uint32_t> rgCounts(RG_BINS * RG_BINS);
+        rgCounter.counts(rgCounts.data());
+        features.rgChromaticity = normalizeCountsL1(rgCounts.data(), (int)rgCounts.size());
+    }
+    if (doUpper) features.rgbUpper = normalizeCountsL1(upperCounts.data(), (int)upperCounts.size());
+    if (doLower) features.rgbLower = normalizeCountsL1(lowerCounts.data(), (int)lowerCounts.size());
+    if (doHsv) {
+        vector<uint32_t> hsvCounts(HSV_BINS);
+        hsvCounter.counts(hsvCounts.data());
+        features.hsvColor = normalizeCountsBySum(hsvCounts.data(), HSV_BINS);
+    }
+    if (doTexture) {
+        uint32_t textureCounts[TEXTURE_BINS];
+        texture.counts(textureCounts);
+        features.sobelTexture = normalizeCountsBySum(textureCounts, TEXTURE_BINS);
+    }
+    return 0;
+}
+
+int extractFusedFeatures(const Mat& image, const vector<FeatureExtractor>& extractors,
+                         const vector<bool>& onImage, vector<vector<float>>& row)
+{
+    int mask = 0, shared = 0;
+    for (size_t f = 0; f < extractors.size(); f++) {
+        if (onImage[f] && row[f].empty() && extractors[f].fused) {
+            mask |= extractors[f].fused;
+            shared++;
+        }
+    }
+
+    FusedFeatures features;
+    if (shared < 2 || computeFusedFeatures(image, features, mask) != 0) return 0;
+
+    for (size_t f = 0; f < extractors.size(); f++) {
+        if (!(onImage[f] && row[f].empty())) continue;
+        switch (extractors[f].fused) {
+        case FUSED_RG_CHROMATICITY: row[f] = features.rgChromaticity; break;
+        case FUSED_RGB_UPPER: row[f] = features.rgbUpper; break;
+        case FUSED_RGB_LOWER: row[f] = features.rgbLower; break;
+        case FUSED_HSV_COLOR: row[f] = features.hsvColor; break;
+        case FUSED_SOBEL_TEXTURE: row[f] = features.sobelTexture; break;
+        default: break;
+        }
+    }
+    return shared;
+}
@@ -0,0 +1,43 @@
+// fused_features.h
+#ifndef FUSED_FEATURES_H
+#define FUSED_FEATURES_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "image_features.h"
+
+// Histograms the fused pass can produce (FeatureExtractor::fused)
+enum FusedFeature {
+    FUSED_RG_CHROMATICITY = 1,  // computeHistogram(image), 16x16
+    FUSED_RGB_UPPER = 2,        // computeUpperRegionHistogram(image)
+    FUSED_RGB_LOWER = 4,        // computeLowerRegionHistogram(image)
+    FUSED_HSV_COLOR = 8,        // getColorHistogram(image)
+    FUSED_SOBEL_TEXTURE = 16,   // getTextureHistogram(image)
+    FUSED_ALL = 31
+};
+
+struct FusedFeatures {
+    std::vector<float> rgChromaticity;
+    std::vector<float> rgbUpper;
+    std::vector<float> rgbLower;
+    std::vector<float> hsvColor;
+    std::vector<float> sobelTexture;
+};
+
+/*
+ * Computes the histograms selected by mask in a single walk over the BGR pixels, row by row. Each row goes
+ * through the rg and HSV bin counters while it is in cache, then per pixel the 8x8x8 RGB bin and the gray
+ * value are derived; the Sobel stencil runs one
+ * row behind on a three-row ring of gray values, so no full-image temporaries are allocated.
+ * The results are bit-identical to the separate functions (OpenCV 4.x fixed-point HSV and gray conversion,
+ * reflect-101 Sobel border). Returns 1 if image is not CV_8UC3.
+ */
+int computeFusedFeatures(const cv::Mat& image, FusedFeatures& features, int mask = FUSED_ALL);
+
+// Fills every empty row[f] whose extractor has a fused bit and reads this image (onImage[f]) from one
+// fused pass. Does nothing unless at least two features share the pass; returns the number filled.
+int extractFusedFeatures(const cv::Mat& image, const std::vector<FeatureExtractor>& extractors,
+                         const std::vector<bool>& onImage, std::vector<std::vector<float>>& row);
+
+
+#endif
@@ -0,0 +1,485 @@
+// histogram_kernels.cpp
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include "histogram_kernels.h"
+#include "distance_kernels.h"
+#include "simd_target.h"
+
+using namespace std;
+
+static const int LANES = 8;
+
+// Follows the ISA the distance kernels picked, so CBIR_SIMD caps these kernels as well
+static bool useAvx2()
+{
+#ifdef SIMD_X86
+    static const bool avx2 = !strcmp(distanceKernelIsa(), "avx512") || !strcmp(distanceKernelIsa(), "avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+RgChromaticityCounter::RgChromaticityCounter(int bins)
+    : numBins(bins), laneSize(bins * bins + 1), lanes((size_t)LANES * (bins * bins + 1), 0)
+{
+}
+
+// calcHist's cvFloor(q * bins) in double; q = r / (r + g + b + 1e-6) in float
+static inline int rgSlot(int b, int g, int r, int bins)
+{
+    float sum = (float)(b + g + r) + 1e-6f;
+    int rb = (int)((double)((float)r / sum) * bins);
+    int gb = (int)((double)((float)g / sum) * bins);
+    return (rb < bins && gb < bins) ? rb * bins + gb : bins * bins;
+}
+
+#ifdef SIMD_X86
+
+// Bins pixels 8 at a time while 10 are left; returns the first pixel it did not bin
+TARGET("avx2") static int rgRowAvx2(const unsigned char* bgr, int cols, uint32_t* hist, int numBins, int laneSize)
+{
+    int x = 0;
+    // two 16-byte loads cover pixels 0-4 and 4-8; the same in-lane shuffle pulls out b, g and r as int32
+    const __m256i pickB = _mm256_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1,
+                                           0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m256i pickG = _mm256_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1,
+                                           1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+    const __m256i pickR = _mm256_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1,
+                                           2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+    const __m256 epsilon = _mm256_set1_ps(1e-6f);
+    const __m256d scale = _mm256_set1_pd((double)numBins);
+    const __m256i binsV = _mm256_set1_epi32(numBins);
+    const __m256i overflow = _mm256_set1_epi32(numBins * numBins);
+    const __m256i laneBase = _mm256_setr_epi32(0, laneSize, 2 * laneSize, 3 * laneSize, 4 * laneSize,
+                                               5 * laneSize, 6 * laneSize, 7 * laneSize);
+    alignas(32) int slots[LANES];
+
+    // the second load reads 4 bytes past the 8th pixel, so stop 10 pixels before the end
+    for (; x + 10 <= cols; x += 8) {
+        const unsigned char* p = bgr + 3 * x;
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+                                            _mm_loadu_si128((const __m128i*)(p + 12)), 1);
+        __m256i b = _mm256_shuffle_epi8(v, pickB);
+        __m256i g = _mm256_shuffle_epi8(v, pickG);
+        __m256i r = _mm256_shuffle_epi8(v, pickR);
+
+        __m256 sum = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(b, g), r)), epsilon);
+        __m256 rq = _mm256_div_ps(_mm256_cvtepi32_ps(r), sum);
+        __m256 gq = _mm256_div_ps(_mm256_cvtepi32_ps(g), sum);
+
+        // q * bins in double, truncated (q >= 0, so this is the floor)
+        __m128i rbLo = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(rq)), scale));
+        __m128i rbHi = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(rq, 1)), scale));
+        __m128i gbLo = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(gq)), scale));
+        __m128i gbHi = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(gq, 1)), scale));
+        __m256i rb = _mm256_inserti128_si256(_mm256_castsi128_si256(rbLo), rbHi, 1);
+        __m256i gb = _mm256_inserti128_si256(_mm256_castsi128_si256(gbLo), gbHi, 1);
+
+        __m256i slot = _mm256_add_epi32(_mm256_mullo_epi32(rb, binsV), gb);
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(rb, _mm256_sub_epi32(binsV, _mm256_set1_epi32(1))),
+                                          _mm256_cmpgt_epi32(gb, _mm256_sub_epi32(binsV, _mm256_set1_epi32(1))));
+        slot = _mm256_blendv_epi8(slot, overflow, outside);
+        _mm256_store_si256((__m256i*)slots, _mm256_add_epi32(slot, laneBase));
+
+        for (int l = 0; l < LANES; l++) {
+            hist[slots[l]]++;
+        }
+    }
+    return x;
+}
+
+#endif  // SIMD_X86
+
+void RgChromaticityCounter::addRow(const unsigned char* bgr, int cols)
+{
+    uint32_t* hist = lanes.data();
+    int x = 0;
+#ifdef SIMD_X86
+    if (useAvx2()) x = rgRowAvx2(bgr, cols, hist, numBins, laneSize);
+#endif
+
+    for (; x < cols; x++) {
+        const unsigned char* p = bgr + 3 * x;
+        hist[(x % LANES) * laneSize + rgSlot(p[0], p[1], p[2], numBins)]++;
+    }
+}
+
+void RgChromaticityCounter::addImage(const unsigned char* bgr, int rows, int cols, size_t step)
+{
+    for (int y = 0; y < rows; y++) {
+        addRow(bgr + (size_t)y * step, cols);
+    }
+}
+
+void RgChromaticityCounter::counts(uint32_t* out) const
+{
+    for (int i = 0; i < numBins * numBins; i++) {
+        uint32_t total = 0;
+        for (int l = 0; l < LANES; l++) total += lanes[(size_t)l * laneSize + i];
+        out[i] = total;
+    }
+}
+
+static const int HSV_SHIFT = 12;
+static const int HSV_BINS = HsvBinCounter::H_BINS * HsvBinCounter::S_BINS * HsvBinCounter::V_BINS;
+
+// Reciprocal tables of OpenCV's 8-bit BGR2HSV
+struct HsvTables {
+    int sdiv[256];
+    int hdiv[256];
+    HsvTables()
+    {
+        sdiv[0] = hdiv[0] = 0;
+        for (int i = 1; i < 256; i++) {
+            sdiv[i] = (int)lround((255 << HSV_SHIFT) / (double)i);
+            hdiv[i] = (int)lround((180 << HSV_SHIFT) / (6.0 * i));
+        }
+    }
+};
+
+static const HsvTables& hsvTables()
+{
+    static const HsvTables tables;
+    return tables;
+}
+
+static inline int hsvSlot(int b, int g, int r, const HsvTables& tables)
+{
+    int v = max(max(b, g), r);
+    int diff = v - min(min(b, g), r);
+    int vr = v == r ? -1 : 0;
+    int vg = v == g ? -1 : 0;
+    int s = (diff * tables.sdiv[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+    h = (h * tables.hdiv[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    h += h < 0 ? 180 : 0;
+    if (h >= 180) return HSV_BINS;
+    return ((h / 6) * HsvBinCounter::S_BINS + (s >> 3)) * HsvBinCounter::V_BINS + (v >> 3);
+}
+
+HsvBinCounter::HsvBinCounter() : hist(HSV_BINS + 1, 0)
+{
+}
+
+#ifdef SIMD_X86
+
+// Bins pixels 8 at a time while 10 are left; returns the first pixel it did not bin
+TARGET("avx2") static int hsvRowAvx2(const unsigned char* bgr, int cols, uint32_t* counts, const HsvTables& tables)
+{
+    int x = 0;
+    // same deinterleave as rgRowAvx2
+    const __m256i pickB = _mm256_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1,
+                                           0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m256i pickG = _mm256_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1,
+                                           1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+    const __m256i pickR = _mm256_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1,
+                                           2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+    const __m256i half = _mm256_set1_epi32(1 << (HSV_SHIFT - 1));
+    const __m256i hueRange = _mm256_set1_epi32(180);
+    const __m256i hueMax = _mm256_set1_epi32(179);
+    const __m256i sixth = _mm256_set1_epi32(10923);  // (h * 10923) >> 16 == h / 6 for 0 <= h < 180
+    const __m256i overflow = _mm256_set1_epi32(HSV_BINS);
+    alignas(32) int slots[LANES];
+
+    for (; x + 10 <= cols; x += 8) {
+        const unsigned char* p = bgr + 3 * x;
+        __m256i px = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+                                             _mm_loadu_si128((const __m128i*)(p + 12)), 1);
+        __m256i b = _mm256_shuffle_epi8(px, pickB);
+        __m256i g = _mm256_shuffle_epi8(px, pickG);
+        __m256i r = _mm256_shuffle_epi8(px, pickR);
+
+        __m256i v = _mm256_max_epi32(_mm256_max_epi32(b, g), r);
+        __m256i diff = _mm256_sub_epi32(v, _mm256_min_epi32(_mm256_min_epi32(b, g), r));
+        __m256i s = _mm256_mullo_epi32(diff, _mm256_i32gather_epi32(tables.sdiv, v, 4));
+        s = _mm256_srai_epi32(_mm256_add_epi32(s, half), HSV_SHIFT);
+
+        // v == r wins over v == g, as in the scalar masks
+        __m256i h = _mm256_blendv_epi8(_mm256_add_epi32(_mm256_sub_epi32(r, g), _mm256_slli_epi32(diff, 2)),
+                                       _mm256_add_epi32(_mm256_sub_epi32(b, r), _mm256_slli_epi32(diff, 1)),
+                                       _mm256_cmpeq_epi32(v, g));
+        h = _mm256_blendv_epi8(h, _mm256_sub_epi32(g, b), _mm256_cmpeq_epi32(v, r));
+        h = _mm256_mullo_epi32(h, _mm256_i32gather_epi32(tables.hdiv, diff, 4));
+        h = _mm256_srai_epi32(_mm256_add_epi32(h, half), HSV_SHIFT);
+        h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), h), hueRange));
+
+        __m256i slot = _mm256_srli_epi32(_mm256_mullo_epi32(h, sixth), 16);
+        slot = _mm256_add_epi32(_mm256_slli_epi32(slot, 5), _mm256_srli_epi32(s, 3));
+        slot = _mm256_add_epi32(_mm256_slli_epi32(slot, 5), _mm256_srli_epi32(v, 3));
+        slot = _mm256_blendv_epi8(slot, overflow, _mm256_cmpgt_epi32(h, hueMax));
+        _mm256_store_si256((__m256i*)slots, slot);
+
+        // 30720 bins spread neighbouring pixels well enough that one histogram beats per-lane copies
+        for (int l = 0; l < LANES; l++) {
+            counts[slots[l]]++;
+        }
+    }
+    return x;
+}
+
+#endif  // SIMD_X86
+
+void HsvBinCounter::addRow(const unsigned char* bgr, int cols)
+{
+    const HsvTables& tables = hsvTables();
+    uint32_t* counts = hist.data();
+    int x = 0;
+#ifdef SIMD_X86
+    if (useAvx2()) x = hsvRowAvx2(bgr, cols, counts, tables);
+#endif
+
+    for (; x < cols; x++) {
+        const unsigned char* p = bgr + 3 * x;
+        counts[hsvSlot(p[0], p[1], p[2], tables)]++;
+    }
+}
+
+void HsvBinCounter::addImage(const unsigned char* bgr, int rows, int cols, size_t step)
+{
+    for (int y = 0; y < rows; y++) {
+        addRow(bgr + (size_t)y * step, cols);
+    }
+}
+
+void HsvBinCounter::counts(uint32_t* out) const
+{
+    copy(hist.begin(), hist.begin() + HSV_BINS, out);
+}
+
+#ifdef SIMD_X86
+
+// Vertical stage 16 values at a time; returns the first value it did not write
+TARGET("avx2") static int sobelVerticalAvx2(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                                            short* vs, short* vd, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(up + i)));
+        __m256i m = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(mid + i)));
+        __m256i d = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(down + i)));
+        if (vs) _mm256_storeu_si256((__m256i*)(vs + i), _mm256_add_epi16(_mm256_add_epi16(u, d), _mm256_slli_epi16(m, 1)));
+        if (vd) _mm256_storeu_si256((__m256i*)(vd + i), _mm256_sub_epi16(d, u));
+    }
+    return i;
+}
+
+// Horizontal stage 16 values at a time from cn; returns the first value it did not write
+TARGET("avx2") static int sobelHorizontalAvx2(const short* vs, const short* vd, short* dx, short* dy, int n, int cn)
+{
+    int i = cn;
+    for (; i + 16 <= n - cn; i += 16) {
+        if (dx) {
+            _mm256_storeu_si256((__m256i*)(dx + i), _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(vs + i + cn)),
+                                                                     _mm256_loadu_si256((const __m256i*)(vs + i - cn))));
+        }
+        if (dy) {
+            __m256i sides = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(vd + i - cn)),
+                                             _mm256_loadu_si256((const __m256i*)(vd + i + cn)));
+            _mm256_storeu_si256((__m256i*)(dy + i),
+                                _mm256_add_epi16(sides, _mm256_slli_epi16(_mm256_loadu_si256((const __m256i*)(vd + i)), 1)));
+        }
+    }
+    return i;
+}
+
+// Rounded magnitudes 16 at a time from `from`; returns the first value it did not write
+TARGET("avx2") static int gradientMagnitudeAvx2(const short* dx, const short* dy, unsigned char* mag, int from, int to)
+{
+    int i = from;
+    for (; i + 16 <= to; i += 16) {
+        __m256i gx = _mm256_loadu_si256((const __m256i*)(dx + i));
+        __m256i gy = _mm256_loadu_si256((const __m256i*)(dy + i));
+        // gx^2 + gy^2 per value from interleaved (gx, gy) pairs; the packs undo the unpack order
+        __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(gx, gy), _mm256_unpacklo_epi16(gx, gy));
+        __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(gx, gy), _mm256_unpackhi_epi16(gx, gy));
+        lo = _mm256_cvtps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(lo)));
+        hi = _mm256_cvtps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(hi)));
+        __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(lo, hi), _mm256_setzero_si256());
+        bytes = _mm256_permute4x64_epi64(bytes, 0x08);
+        _mm_storeu_si128((__m128i*)(mag + i), _mm256_castsi256_si128(bytes));
+    }
+    return i;
+}
+
+#endif  // SIMD_X86
+
+void sobelRowGradients(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                       short* vs, short* vd, short* dx, short* dy, int n, int cn)
+{
+    // the vertical sums only feed the gradients that were asked for
+    if (!dx) vs = nullptr;
+    if (!dy) vd = nullptr;
+
+    int i = 0;
+#ifdef SIMD_X86
+    if (useAvx2()) i = sobelVerticalAvx2(up, mid, down, vs, vd, n);
+#endif
+    for (; i < n; i++) {
+        if (vs) vs[i] = (short)(up[i] + 2 * mid[i] + down[i]);
+        if (vd) vd[i] = (short)(down[i] - up[i]);
+    }
+
+    i = cn;
+#ifdef SIMD_X86
+    if (useAvx2()) i = sobelHorizontalAvx2(vs, vd, dx, dy, n, cn);
+#endif
+    for (; i < n - cn; i++) {
+        if (dx) dx[i] = (short)(vs[i + cn] - vs[i - cn]);
+        if (dy) dy[i] = (short)(vd[i - cn] + 2 * vd[i] + vd[i + cn]);
+    }
+}
+
+void gradientMagnitudeRow(const short* dx, const short* dy, unsigned char* mag, int from, int to)
+{
+    int i = from;
+#ifdef SIMD_X86
+    if (useAvx2()) i = gradientMagnitudeAvx2(dx, dy, mag, from, to);
+#endif
+    for (; i < to; i++) {
+        long m = lrintf(sqrtf((float)(dx[i] * dx[i] + dy[i] * dy[i])));
+        mag[i] = (unsigned char)(m > 255 ? 255 : m);
+    }
+}
+
+static const int TEXTURE_BINS = 256;
+static const int TEXTURE_LANE = TEXTURE_BINS + 1;  // + out-of-range slot
+
+// floor(sqrt(m2)) in float, or the out-of-range slot from 256 up
+static inline int textureBin(int m2)
+{
+    return m2 < TEXTURE_BINS * TEXTURE_BINS ? (int)sqrtf((float)m2) : TEXTURE_BINS;
+}
+
+// BORDER_REFLECT_101 index, as Sobel's default border
+static inline int reflect101(int i, int n)
+{
+    if (n == 1) return 0;
+    if (i < 0) return -i;
+    if (i >= n) return 2 * n - 2 - i;
+    return i;
+}
+
+SobelMagnitudeCounter::SobelMagnitudeCounter(int rows, int cols)
+    : rows(rows), cols(cols), ring(3 * (size_t)cols), vs(cols), vd(cols), gx(cols), gy(cols),
+      lanes((size_t)LANES * TEXTURE_LANE, 0)
+{
+}
+
+unsigned char* SobelMagnitudeCounter::nextRow()
+{
+    return &ring[(size_t)(committed % 3) * cols];
+}
+
+void SobelMagnitudeCounter::commitRow()
+{
+    int y = committed++;
+    // the stencil of row y - 1 is complete once row y is in; the last row reflects back inside
+    if (y >= 1) magnitudeRow(y - 1);
+    if (committed == rows) magnitudeRow(rows - 1);
+}
+
+void SobelMagnitudeCounter::addBgrRow(const unsigned char* bgr)
+{
+    bgrRowToGray(bgr, nextRow(), cols);
+    commitRow();
+}
+
+#ifdef SIMD_X86
+
+// Bins interior pixels 8 at a time from x = 1 up to `to`; returns the first pixel it did not bin
+TARGET("avx2") static int binMagnitudesAvx2(const short* dx, const short* dy, int to, uint32_t* hist)
+{
+    int x = 1;
+    const __m256i limit = _mm256_set1_epi32(TEXTURE_BINS * TEXTURE_BINS - 1);
+    const __m256i overflow = _mm256_set1_epi32(TEXTURE_BINS);
+    const __m256i laneBase = _mm256_setr_epi32(0, TEXTURE_LANE, 2 * TEXTURE_LANE, 3 * TEXTURE_LANE, 4 * TEXTURE_LANE,
+                                               5 * TEXTURE_LANE, 6 * TEXTURE_LANE, 7 * TEXTURE_LANE);
+    alignas(32) int slots[LANES];
+
+    for (; x + 8 <= to; x += 8) {
+        __m256i gx = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(dx + x)));
+        __m256i gy = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(dy + x)));
+        __m256i m2 = _mm256_add_epi32(_mm256_mullo_epi32(gx, gx), _mm256_mullo_epi32(gy, gy));
+
+        __m256i bin = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(m2)));
+        bin = _mm256_blendv_epi8(bin, overflow, _mm256_cmpgt_epi32(m2, limit));
+        _mm256_store_si256((__m256i*)slots, _mm256_add_epi32(bin, laneBase));
+        for (int l = 0; l < LANES; l++) {
+            hist[slots[l]]++;
+        }
+    }
+    return x;
+}
+
+#endif  // SIMD_X86
+
+void SobelMagnitudeCounter::magnitudeRow(int y)
+{
+    const unsigned char* up = &ring[(size_t)(reflect101(y - 1, rows) % 3) * cols];
+    const unsigned char* mid = &ring[(size_t)(y % 3) * cols];
+    const unsigned char* down = &ring[(size_t)(reflect101(y + 1, rows) % 3) * cols];
+    uint32_t* hist = lanes.data();
+
+    // the first and last pixel reflect their missing neighbour
+    auto borderPixel = [&](int x) {
+        int xl = reflect101(x - 1, cols);
+        int xr = reflect101(x + 1, cols);
+        int dx = (up[xr] - up[xl]) + 2 * (mid[xr] - mid[xl]) + (down[xr] - down[xl]);
+        int dy = (down[xl] + 2 * down[x] + down[xr]) - (up[xl] + 2 * up[x] + up[xr]);
+        hist[(x % LANES) * TEXTURE_LANE + textureBin(dx * dx + dy * dy)]++;
+    };
+
+    borderPixel(0);
+    if (cols == 1) return;
+
+    sobelRowGradients(up, mid, down, vs.data(), vd.data(), gx.data(), gy.data(), cols, 1);
+    int x = 1;
+#ifdef SIMD_X86
+    if (useAvx2()) x = binMagnitudesAvx2(gx.data(), gy.data(), cols - 1, hist);
+#endif
+    for (; x < cols - 1; x++) {
+        hist[(x % LANES) * TEXTURE_LANE + textureBin(gx[x] * gx[x] + gy[x] * gy[x])]++;
+    }
+
+    borderPixel(cols - 1);
+}
+
+void SobelMagnitudeCounter::counts(uint32_t* out) const
+{
+    for (int i = 0; i < TEXTURE_BINS; i++) {
+        uint32_t total = 0;
+        for (int l = 0; l < LANES; l++) total += lanes[(size_t)l * TEXTURE_LANE + i];
+        out[i] = total;
+    }
+}
+
+void bgrRowToGray(const unsigned char* bgr, unsigned char* gray, int cols)
+{
+    for (int x = 0; x < cols; x++, bgr += 3) {
+        gray[x] = (unsigned char)((bgr[0] * 3735 + bgr[1] * 19235 + bgr[2] * 9798 + (1 << 14)) >> 15);
+    }
+}
+
+vector<float> normalizeCountsL1(const uint32_t* counts, int n)
+{
+    double total = 0;
+    for (int i = 0; i < n; i++) total += counts[i];
+    float scale = (float)(total > DBL_EPSILON ? 1.0 / total : 0.0);
+
+    vector<float> hist(n);
+    for (int i = 0; i < n; i++) hist[i] = (float)counts[i] * scale;
+    return hist;
+}
+
+vector<float> normalizeCountsBySum(const uint32_t* counts, int n)
+{
+    double histSum = 0;
+    for (int i = 0; i < n; i++) histSum += counts[i];
+
+    vector<float> hist(n);
+    for (int i = 0; i < n; i++) hist[i] = (float)(counts[i] / histSum);
+    return hist;
+}
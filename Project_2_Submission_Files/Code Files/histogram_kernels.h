@@ -0,0 +1,109 @@
+// histogram_kernels.h
+#ifndef HISTOGRAM_KERNELS_H
+#define HISTOGRAM_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * rg-chromaticity bin counts straight from interleaved BGR bytes, matching computeHistogram's
+ * float r / (r + g + b + 1e-6) and calcHist binning bit for bit. On CPUs with AVX2 (picked at
+ * runtime like the distance kernels) it deinterleaves and divides 8 pixels at a time; otherwise a
+ * scalar loop is used. Counts go into 8 per-lane sub-histograms (plus a slot for out-of-range
+ * pixels) that are merged by counts().
+ */
+class RgChromaticityCounter {
+public:
+    explicit RgChromaticityCounter(int bins = 16);
+
+    void addRow(const unsigned char* bgr, int cols);
+    void addImage(const unsigned char* bgr, int rows, int cols, size_t step);
+
+    // bins * bins merged counts, r-major like the calcHist result
+    void counts(uint32_t* out) const;
+    int bins() const { return numBins; }
+
+private:
+    int numBins;
+    int laneSize;                 // bins * bins + 1 overflow slot
+    std::vector<uint32_t> lanes;  // 8 sub-histograms
+};
+
+/*
+ * 30x32x32 HSV bin counts as getColorHistogram computes them (BGR2HSV then calcHist over H [0, 180), S and
+ * V [0, 256)), mapped straight from BGR bytes without an HSV image. Hue, saturation and value use OpenCV's
+ * 8-bit fixed-point BGR2HSV arithmetic (12-bit reciprocal tables), so the bins are identical to the
+ * cvtColor + calcHist path: the tolerance is zero. With AVX2 (at runtime) 8 pixels are converted at a time,
+ * the reciprocals coming from table gathers. Bin index is (h / 6 * 32 + s / 8) * 32 + v / 8.
+ */
+class HsvBinCounter {
+public:
+    static const int H_BINS = 30, S_BINS = 32, V_BINS = 32;
+
+    HsvBinCounter();
+
+    void addRow(const unsigned char* bgr, int cols);
+    void addImage(const unsigned char* bgr, int rows, int cols, size_t step);
+
+    // H_BINS * S_BINS * V_BINS merged counts, h-major like the calcHist result
+    void counts(uint32_t* out) const;
+
+private:
+    std::vector<uint32_t> hist;  // bins + a slot for hue 180 (outside calcHist's range)
+};
+
+/*
+ * 256-bin Sobel gradient-magnitude counts as getTextureHistogram computes them (BGR2GRAY, 3x3 Sobel with
+ * the reflect-101 border, floor(sqrt(gx^2 + gy^2)) below 256), streamed one gray row at a time. The stencil
+ * runs one row behind on a three-row ring through sobelRowGradients, so only one row of gradients exists.
+ * With AVX2 (at runtime) 8 squared magnitudes are rooted at once; binning the exact integer squared
+ * magnitude with sqrt in float gives the same bins as the float Sobel path.
+ */
+class SobelMagnitudeCounter {
+public:
+    SobelMagnitudeCounter(int rows, int cols);
+
+    // Buffer for the next gray row (cols bytes); call commitRow() once it is filled
+    unsigned char* nextRow();
+    void commitRow();
+    void addBgrRow(const unsigned char* bgr);  // BGR2GRAY into nextRow(), then commitRow()
+
+    // 256 counts; valid after all rows are committed
+    void counts(uint32_t* out) const;
+
+private:
+    void magnitudeRow(int y);
+
+    int rows, cols;
+    int committed = 0;
+    std::vector<unsigned char> ring;  // gray rows y % 3
+    std::vector<short> vs, vd;        // vertical stage of the row being differentiated
+    std::vector<short> gx, gy;        // its gradients
+    std::vector<uint32_t> lanes;      // 8 sub-histograms of 256 bins + an out-of-range slot
+};
+
+/*
+ * 3x3 Sobel stencil of one row of n values whose horizontal neighbours are cn apart (cn = 1 for gray, 3 for
+ * interleaved BGR). The vertical stage fills vs = up + 2 * mid + down and vd = down - up; the horizontal
+ * stage writes dx = vs[i + cn] - vs[i - cn] and dy = vd[i - cn] + 2 * vd[i] + vd[i + cn] for i in
+ * [cn, n - cn). A null dx or dy skips that gradient. SobelMagnitudeCounter and sobelXY3x3 (utils.h)
+ * both use it; the AVX2 path is picked at runtime.
+ */
+void sobelRowGradients(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                       short* vs, short* vd, short* dx, short* dy, int n, int cn);
+
+// mag[i] = sqrt(dx[i]^2 + dy[i]^2) rounded and saturated to 255, for i in [from, to)
+void gradientMagnitudeRow(const short* dx, const short* dy, unsigned char* mag, int from, int to);
+
+// BGR2GRAY of one row, OpenCV 4.x 15-bit fixed point
+void bgrRowToGray(const unsigned char* bgr, unsigned char* gray, int cols);
+
+// normalize(hist, hist, 1, 0, NORM_L1) of a calcHist result with these counts
+std::vector<float> normalizeCountsL1(const uint32_t* counts, int n);
+
+// counts[i] / sum (double), as getColorHistogram and getTextureHistogram normalize
+std::vector<float> normalizeCountsBySum(const uint32_t* counts, int n);
+
+
+#endif
@@ -0,0 +1,432 @@
+// hnsw_index.cpp
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include "hnsw_index.h"
+#include "distance_kernels.h"
+
+static const uint64_t HNSW_ALIGNMENT = 64;
+static const uint32_t HNSW_MAX_LEVEL = 31;
+
+typedef std::pair<float, uint32_t> Candidate; // (SSD to the query, node)
+
+// splitmix64 finalizer
+static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Top layer of node i: floor(-ln(u) / ln(M)) for u uniform in (0, 1], drawn from the seed and i alone
+static uint32_t draw_level(uint64_t seed, size_t i, size_t m) {
+    double u = (double)((mix64(seed ^ mix64(i)) >> 11) + 1) * (1.0 / 9007199254740992.0);
+    double level = -std::log(u) / std::log((double)m);
+    return (uint32_t)std::min<double>(level, HNSW_MAX_LEVEL);
+}
+
+// Marks the nodes a search has reached; bumping the epoch clears it in O(1)
+struct VisitedSet {
+    std::vector<uint32_t> marks;
+    uint32_t epoch = 0;
+
+    void reset(size_t n) {
+        if (marks.size() != n || ++epoch == 0) {
+            marks.assign(n, 0);
+            epoch = 1;
+        }
+    }
+    bool visit(uint32_t i) {
+        if (marks[i] == epoch) return false;
+        marks[i] = epoch;
+        return true;
+    }
+};
+
+/*
+ * Best-first search of one layer from entry, tracking the ef nearest nodes found; returns them nearest first.
+ * links(node, layer, visit) calls visit with the node's link block (count, then neighbours). Nodes for which
+ * skip (if given) is true are walked through but never found, so up to ef other nodes are still returned.
+ */
+template <typename Links>
+static std::vector<Candidate> search_layer(const float* query, const float* vectors, size_t stride, size_t dim,
+                                           const Candidate& entry, size_t ef, uint32_t layer, VisitedSet& visited,
+                                           const Links& links, const std::function<bool(size_t)>& skip = nullptr) {
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates; // nearest on top
+    std::priority_queue<Candidate> found;                                                       // farthest on top
+
+    visited.visit(entry.second);
+    candidates.push(entry);
+    if (!skip || !skip(entry.second)) found.push(entry);
+    while (!candidates.empty()) {
+        Candidate c = candidates.top();
+        if (found.size() >= ef && c.first > found.top().first) break; // nothing left can get closer than what was found
+        candidates.pop();
+
+        links(c.second, layer, [&](const uint32_t* block) {
+            for (uint32_t j = 1; j <= block[0]; j++) {
+                uint32_t n = block[j];
+                if (!visited.visit(n)) continue;
+
+                float d = ssdDistance(query, vectors + n * stride, dim);
+                if (found.size() < ef || d < found.top().first) {
+                    candidates.push(Candidate(d, n));
+                    if (skip && skip(n)) continue;
+                    found.push(Candidate(d, n));
+                    if (found.size() > ef) found.pop();
+                }
+            }
+        });
+    }
+
+    std::vector<Candidate> nearest(found.size());
+    for (size_t i = nearest.size(); i-- > 0; found.pop()) {
+        nearest[i] = found.top();
+    }
+    return nearest;
+}
+
+/*
+ * The neighbour selection heuristic of the HNSW paper: walks the candidates nearest first and keeps one only
+ * if it is closer to the base node than to every neighbour kept so far, so the links spread out in different
+ * directions instead of crowding into one cluster.
+ */
+static void select_neighbours(const std::vector<Candidate>& nearest, size_t max_links, const float* vectors,
+                              size_t stride, size_t dim, std::vector<uint32_t>& selected) {
+    selected.clear();
+    for (const Candidate& c : nearest) {
+        if (selected.size() >= max_links) break;
+
+        bool keep = true;
+        for (uint32_t s : selected) {
+            if (ssdDistance(vectors + c.second * stride, vectors + s * stride, dim) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) selected.push_back(c.second);
+    }
+}
+
+/*
+ * Checks a mapped graph before it is searched: the upper-layer blocks are laid out back to back as build
+ * lays them out, link counts fit their blocks, and every link names a row that reaches the link's layer, so
+ * a search never reads outside the file. One pass over the links.
+ */
+static bool graph_is_valid(const uint32_t* level0, const uint8_t* levels, const uint64_t* upper_offsets,
+                           const uint32_t* upper, uint64_t rows, uint64_t m, uint32_t max_level,
+                           uint32_t entry_point, uint64_t upper_count) {
+    if (rows == 0) return true;
+    if (levels[entry_point] != max_level || upper_offsets[0] != 0) return false;
+    for (uint64_t i = 0; i < rows; i++) {
+        if (levels[i] > max_level || upper_offsets[i + 1] != upper_offsets[i] + levels[i] * (1 + m)) return false;
+    }
+    if (upper_offsets[rows] != upper_count) return false;
+
+    for (uint64_t i = 0; i < rows; i++) {
+        for (uint32_t layer = 0; layer <= levels[i]; layer++) {
+            const uint32_t* b = layer == 0 ? level0 + i * (1 + 2 * m) : upper + upper_offsets[i] + (layer - 1) * (1 + m);
+            if (b[0] > (layer == 0 ? 2 * m : m)) return false;
+            for (uint32_t j = 1; j <= b[0]; j++) {
+                if (b[j] >= rows || levels[b[j]] < layer) return false;
+            }
+        }
+    }
+    return true;
+}
+
+HnswIndex::HnswIndex()
+    : level0(nullptr), levels(nullptr), upper_offsets(nullptr), upper(nullptr), vectors(nullptr), count(0), cols(0),
+      stride(0), m(0), max_level(0), entry_point(0) {
+}
+
+HnswIndex::~HnswIndex() {
+    close();
+}
+
+void HnswIndex::set_views() {
+    level0 = level0_links.data();
+    levels = node_levels.data();
+    upper_offsets = upper_offset_table.data();
+    upper = upper_links.data();
+}
+
+int HnswIndex::build(WorkStealingPool& pool, const float* data, size_t rows, size_t dim, size_t row_stride,
+                     const HnswParams& params) {
+    close();
+    if (rows >= UINT32_MAX || params.m < 2) {
+        fprintf(stderr, "HNSW index needs M >= 2 and fewer than 2^32 rows\n");
+        return 1;
+    }
+
+    vectors = data;
+    count = rows;
+    cols = dim;
+    stride = row_stride;
+    m = params.m;
+    const size_t m0 = 2 * m; // layer 0 holds most of the graph and gets twice the links
+    const size_t ef = std::max(params.ef_construction, m);
+
+    // layers are drawn up front, so the upper link blocks can be laid out as they are saved
+    node_levels.resize(rows);
+    upper_offset_table.assign(rows + 1, 0);
+    for (size_t i = 0; i < rows; i++) {
+        node_levels[i] = (uint8_t)draw_level(params.seed, i, m);
+        upper_offset_table[i + 1] = upper_offset_table[i] + node_levels[i] * (1 + m);
+    }
+    level0_links.assign(rows * (1 + m0), 0);
+    upper_links.assign((size_t)upper_offset_table[rows], 0);
+    set_views();
+    if (rows == 0) return 0;
+
+    auto block = [&](uint32_t node, uint32_t layer) -> uint32_t* {
+        return layer == 0 ? &level0_links[node * (1 + m0)] : &upper_links[upper_offset_table[node] + (layer - 1) * (1 + m)];
+    };
+    auto vec = [&](uint32_t node) { return data + node * row_stride; };
+
+    // node 0 starts as the entry point; entry_state packs (top layer << 32) | entry node
+    std::unique_ptr<std::mutex[]> locks(new std::mutex[rows]);
+    std::mutex top_mutex;
+    std::atomic<uint64_t> entry_state(((uint64_t)node_levels[0] << 32) | 0);
+    std::vector<VisitedSet> visited(pool.size() + 1); // one per worker, plus the calling thread
+
+    pool.parallel_for(rows - 1, [&](size_t i) {
+        const uint32_t q = (uint32_t)(i + 1);
+        const float* qv = vec(q);
+        const uint32_t level = node_levels[q];
+        VisitedSet& vis = visited[WorkStealingPool::current_worker() + 1];
+
+        // other threads link nodes while this one walks the graph: copy each link block under its lock
+        std::vector<uint32_t> copied(1 + m0);
+        auto links = [&](uint32_t node, uint32_t layer, const std::function<void(const uint32_t*)>& visit) {
+            const uint32_t* b = block(node, layer);
+            {
+                std::lock_guard<std::mutex> lock(locks[node]);
+                std::copy(b, b + 1 + b[0], copied.begin());
+            }
+            visit(copied.data());
+        };
+
+        // a node that reaches above the current top layer becomes the entry point; hold the lock until it is
+        std::unique_lock<std::mutex> top_lock(top_mutex, std::defer_lock);
+        uint64_t state = entry_state.load();
+        if (level > (state >> 32)) {
+            top_lock.lock();
+            state = entry_state.load();
+            if (level <= (state >> 32)) top_lock.unlock();
+        }
+        const uint32_t top = (uint32_t)(state >> 32);
+        const uint32_t ep = (uint32_t)state;
+
+        // greedy descent through the layers above the new node's own
+        Candidate entry(ssdDistance(qv, vec(ep), dim), ep);
+        for (uint32_t layer = top; layer > level; layer--) {
+            vis.reset(rows);
+            entry = search_layer(qv, data, row_stride, dim, entry, 1, layer, vis, links)[0];
+        }
+
+        // Adds link to node's block, re-selecting among the old links and the new one once the block is full
+        std::vector<uint32_t> kept;
+        auto add_link = [&](uint32_t node, uint32_t layer, uint32_t link) {
+            const size_t max_links = layer == 0 ? m0 : m;
+            uint32_t* b = block(node, layer);
+            if (std::find(b + 1, b + 1 + b[0], link) != b + 1 + b[0]) return;
+            if (b[0] < max_links) {
+                b[1 + b[0]++] = link;
+                return;
+            }
+            std::vector<Candidate> linked;
+            linked.push_back(Candidate(ssdDistance(vec(node), vec(link), dim), link));
+            for (uint32_t j = 1; j <= b[0]; j++) {
+                linked.push_back(Candidate(ssdDistance(vec(node), vec(b[j]), dim), b[j]));
+            }
+            std::sort(linked.begin(), linked.end());
+            select_neighbours(linked, max_links, data, row_stride, dim, kept);
+            b[0] = (uint32_t)kept.size();
+            std::copy(kept.begin(), kept.end(), b + 1);
+        };
+
+        std::vector<uint32_t> selected;
+        for (uint32_t layer = std::min(top, level) + 1; layer-- > 0;) {
+            vis.reset(rows);
+            std::vector<Candidate> nearest = search_layer(qv, data, row_stride, dim, entry, ef, layer, vis, links);
+            select_neighbours(nearest, m, data, row_stride, dim, selected);
+
+            // nodes inserted meanwhile may already link here, so the new links are added to the block, not written over it
+            {
+                std::lock_guard<std::mutex> lock(locks[q]);
+                for (uint32_t n : selected) add_link(q, layer, n);
+            }
+            for (uint32_t n : selected) {
+                std::lock_guard<std::mutex> lock(locks[n]);
+                add_link(n, layer, q);
+            }
+            entry = nearest[0];
+        }
+
+        if (top_lock.owns_lock()) {
+            entry_state.store(((uint64_t)level << 32) | q);
+        }
+    });
+
+    max_level = (uint32_t)(entry_state.load() >> 32);
+    entry_point = (uint32_t)entry_state.load();
+    return 0;
+}
+
+int HnswIndex::save(const char* filename) const {
+    if (!upper_offsets) {
+        fprintf(stderr, "No HNSW index to save; build or open one first\n");
+        return 1;
+    }
+
+    HnswHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HNSW_MAGIC, sizeof(HNSW_MAGIC));
+    header.version = HNSW_VERSION;
+    header.m = (uint32_t)m;
+    header.rows = count;
+    header.dim = cols;
+    header.max_level = max_level;
+    header.entry_point = entry_point;
+    header.upper_count = upper_offsets[count];
+
+    uint64_t level0_bytes = count * (1 + 2 * m) * sizeof(uint32_t);
+    header.level0_offset = align_up(sizeof(header), HNSW_ALIGNMENT);
+    header.levels_offset = align_up(header.level0_offset + level0_bytes, HNSW_ALIGNMENT);
+    header.upper_offsets_offset = align_up(header.levels_offset + count, HNSW_ALIGNMENT);
+    header.upper_offset = align_up(header.upper_offsets_offset + (count + 1) * sizeof(uint64_t), HNSW_ALIGNMENT);
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("Unable to open HNSW index for writing");
+        return 1;
+    }
+
+    int err = fwrite(&header, sizeof(header), 1, fp) != 1;
+    err |= write_padding(fp, sizeof(header), header.level0_offset);
+    if (count > 0) {
+        err |= fwrite(level0, 1, (size_t)level0_bytes, fp) != level0_bytes;
+        err |= write_padding(fp, header.level0_offset + level0_bytes, header.levels_offset);
+        err |= fwrite(levels, 1, count, fp) != count;
+        err |= write_padding(fp, header.levels_offset + count, header.upper_offsets_offset);
+    }
+    err |= fwrite(upper_offsets, sizeof(uint64_t), count + 1, fp) != count + 1;
+    err |= write_padding(fp, header.upper_offsets_offset + (count + 1) * sizeof(uint64_t), header.upper_offset);
+    if (header.upper_count > 0) {
+        err |= fwrite(upper, sizeof(uint32_t), (size_t)header.upper_count, fp) != header.upper_count;
+    }
+    err |= fclose(fp) != 0;
+
+    if (err) {
+        fprintf(stderr, "Error writing HNSW index %s\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+int HnswIndex::open(const char* filename, const float* data, size_t rows, size_t dim, size_t row_stride) {
+    close();
+    if (map_file_readonly(filename, file)) {
+        return 1;
+    }
+
+    HnswHeader header;
+    if (file.size < sizeof(header)) {
+        fprintf(stderr, "HNSW index %s is truncated\n", filename);
+        close();
+        return 1;
+    }
+    memcpy(&header, file.data, sizeof(header));
+
+    if (memcmp(header.magic, HNSW_MAGIC, sizeof(HNSW_MAGIC)) != 0 || header.version != HNSW_VERSION) {
+        fprintf(stderr, "%s is not an HNSW index (or has an unsupported version)\n", filename);
+        close();
+        return 1;
+    }
+    if (header.rows != rows || header.dim != dim) {
+        fprintf(stderr, "HNSW index %s was built over %llu x %llu features, not %zu x %zu\n", filename,
+                (unsigned long long)header.rows, (unsigned long long)header.dim, rows, dim);
+        close();
+        return 1;
+    }
+
+    // every section aligned and inside the file; written so that a corrupt header cannot overflow the sums
+    bool ok = header.m >= 2 && header.max_level <= HNSW_MAX_LEVEL && (header.rows == 0 || header.entry_point < header.rows) &&
+              header.level0_offset % HNSW_ALIGNMENT == 0 && header.upper_offsets_offset % HNSW_ALIGNMENT == 0 &&
+              header.upper_offset % HNSW_ALIGNMENT == 0 &&
+              header.level0_offset <= file.size &&
+              header.rows <= (file.size - header.level0_offset) / sizeof(uint32_t) / (1 + 2 * (uint64_t)header.m) &&
+              header.levels_offset <= file.size && header.rows <= file.size - header.levels_offset &&
+              header.upper_offsets_offset <= file.size &&
+              header.rows < (file.size - header.upper_offsets_offset) / sizeof(uint64_t) &&
+              header.upper_offset <= file.size && header.upper_count <= (file.size - header.upper_offset) / sizeof(uint32_t);
+    ok = ok && graph_is_valid((const uint32_t*)(file.data + header.level0_offset), (const uint8_t*)(file.data + header.levels_offset),
+                              (const uint64_t*)(file.data + header.upper_offsets_offset),
+                              (const uint32_t*)(file.data + header.upper_offset), header.rows, header.m, header.max_level,
+                              header.entry_point, header.upper_count);
+    if (!ok) {
+        fprintf(stderr, "HNSW index %s is corrupt\n", filename);
+        close();
+        return 1;
+    }
+
+    level0 = (const uint32_t*)(file.data + header.level0_offset);
+    levels = (const uint8_t*)(file.data + header.levels_offset);
+    upper_offsets = (const uint64_t*)(file.data + header.upper_offsets_offset);
+    upper = (const uint32_t*)(file.data + header.upper_offset);
+    vectors = data;
+    count = rows;
+    cols = dim;
+    stride = row_stride;
+    m = header.m;
+    max_level = header.max_level;
+    entry_point = header.entry_point;
+    return 0;
+}
+
+void HnswIndex::close() {
+    unmap_file(file);
+    level0_links.clear();
+    node_levels.clear();
+    upper_offset_table.clear();
+    upper_links.clear();
+    level0 = nullptr;
+    levels = nullptr;
+    upper_offsets = nullptr;
+    upper = nullptr;
+    vectors = nullptr;
+    count = cols = stride = m = 0;
+    max_level = entry_point = 0;
+}
+
+std::vector<std::pair<float, size_t>> HnswIndex::search(const float* query, size_t k, size_t ef,
+                                                        const std::function<bool(size_t)>& skipRow) const {
+    std::vector<std::pair<float, size_t>> matches;
+    if (count == 0 || k == 0) return matches;
+
+    auto links = [&](uint32_t node, uint32_t layer, const std::function<void(const uint32_t*)>& visit) {
+        visit(layer == 0 ? level0 + node * (1 + 2 * m) : upper + upper_offsets[node] + (layer - 1) * (1 + m));
+    };
+
+    VisitedSet visited;
+    Candidate entry(ssdDistance(query, vectors + entry_point * stride, cols), entry_point);
+    for (uint32_t layer = max_level; layer > 0; layer--) {
+        visited.reset(count);
+        entry = search_layer(query, vectors, stride, cols, entry, 1, layer, visited, links)[0];
+    }
+    visited.reset(count);
+    std::vector<Candidate> nearest = search_layer(query, vectors, stride, cols, entry, std::max(ef, k), 0, visited, links,
+                                                  skipRow);
+
+    for (size_t i = 0; i < nearest.size() && i < k; i++) {
+        matches.push_back(std::make_pair(nearest[i].first, (size_t)nearest[i].second));
+    }
+    return matches;
+}
@@ -0,0 +1,112 @@
+// hnsw_index.h
+#ifndef HNSW_INDEX_H
+#define HNSW_INDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+/*
+ * HNSW (hierarchical navigable small world) graph over the rows of a feature matrix, for approximate
+ * nearest-neighbour search by SSD in roughly logarithmic time instead of a linear scan. The index only
+ * holds the graph; the vectors stay where they are (usually the mapped feature store it was built from).
+ *
+ * On disk (.hnsw), in native (little-endian) byte order, every section 64-byte aligned:
+ *
+ *   HnswHeader
+ *   uint32_t level0[rows][1 + 2M]     layer 0 links of each node: count, then up to 2M neighbours
+ *   uint8_t levels[rows]              top layer of each node
+ *   uint64_t upper_offsets[rows + 1]  where each node's upper-layer links start in upper[]
+ *   uint32_t upper[]                  layers 1..levels[i] of node i, [1 + M] each: count, then neighbours
+ */
+#define HNSW_MAGIC "CBIRHNS"
+#define HNSW_VERSION 1
+
+struct HnswHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t m;
+    uint64_t rows;
+    uint64_t dim;
+    uint32_t max_level;
+    uint32_t entry_point;
+    uint64_t level0_offset;
+    uint64_t levels_offset;
+    uint64_t upper_offsets_offset;
+    uint64_t upper_offset;
+    uint64_t upper_count; // uint32_t entries in upper[]
+};
+
+struct HnswParams {
+    size_t m = 16;                // links per node on the upper layers (2M on layer 0)
+    size_t ef_construction = 200; // candidates tracked while linking a new node
+    uint64_t seed = 100;          // node layers are drawn from it, so they do not depend on the thread count
+};
+
+class HnswIndex {
+public:
+    HnswIndex();
+    ~HnswIndex();
+
+    /*
+     * Builds the graph over rows vectors of dim floats, row i at data + i * stride, inserting on all workers
+     * of the pool (the graph is only reproducible with a single worker). The vectors are not copied and have
+     * to stay unchanged while the index is used. The function returns 0 on success and 1 on error.
+     */
+    int build(WorkStealingPool& pool, const float* data, size_t rows, size_t dim, size_t stride, const HnswParams& params);
+
+    // Writes the graph; returns 0 on success and 1 on error
+    int save(const char* filename) const;
+
+    /*
+     * Maps a saved graph for searching; data, rows, dim and stride describe the vectors it was built over.
+     * Nothing is copied; the links are checked in one pass so a corrupt file cannot send a search outside
+     * it. Returns 0 on success and 1 on error.
+     */
+    int open(const char* filename, const float* data, size_t rows, size_t dim, size_t stride);
+    void close();
+
+    /*
+     * The k approximate nearest rows of query by SSD, best first, as (SSD, row). ef (efSearch, raised to k
+     * if smaller) is the number of candidates tracked: larger is slower and finds more of the true neighbours.
+     * skipRow, if given, leaves rows out of the results; they are still walked through and do not count
+     * against ef, so k results come back whenever k other rows are reachable.
+     */
+    std::vector<std::pair<float, size_t>> search(const float* query, size_t k, size_t ef,
+                                                 const std::function<bool(size_t)>& skipRow = nullptr) const;
+
+    size_t rows() const { return count; }
+    size_t dim() const { return cols; }
+
+private:
+    HnswIndex(const HnswIndex&) = delete;
+    HnswIndex& operator=(const HnswIndex&) = delete;
+
+    void set_views();
+
+    MappedFile file;
+    std::vector<uint32_t> level0_links;
+    std::vector<uint8_t> node_levels;
+    std::vector<uint64_t> upper_offset_table;
+    std::vector<uint32_t> upper_links;
+
+    const uint32_t* level0;
+    const uint8_t* levels;
+    const uint64_t* upper_offsets;
+    const uint32_t* upper;
+
+    const float* vectors;
+    size_t count;
+    size_t cols;
+    size_t stride;
+    size_t m;
+    uint32_t max_level;
+    uint32_t entry_point;
+};
+
+
+#endif
@@ -0,0 +1,107 @@
+// image_decode.cpp
+#include <algorithm>
+#include <cstdio>
+#include "image_decode.h"
+#include "jpeg_fast_decode.h"
+
+using namespace cv;
+using namespace std;
+
+bool readFileBytes(const string& path, vector<uchar>& bytes)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+
+    bool ok = fseek(fp, 0, SEEK_END) == 0;
+    long size = ok ? ftell(fp) : -1;
+    ok = ok && size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+    if (ok) {
+        bytes.resize((size_t)size);
+        ok = size == 0 || fread(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+    }
+    fclose(fp);
+    return ok;
+}
+
+bool isJpeg(const vector<uchar>& bytes)
+{
+    return bytes.size() >= 3 && bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF;
+}
+
+static int be16(const uchar* p) { return (p[0] << 8) | p[1]; }
+static unsigned be32(const uchar* p) { return ((unsigned)p[0] << 24) | ((unsigned)p[1] << 16) | ((unsigned)p[2] << 8) | p[3]; }
+
+bool readImageSize(const vector<uchar>& bytes, int& width, int& height)
+{
+    const uchar* p = bytes.data();
+    size_t n = bytes.size();
+
+    // PNG: signature, then the IHDR chunk
+    static const uchar png[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    if (n >= 24 && equal(png, png + 8, p)) {
+        width = (int)be32(p + 16);
+        height = (int)be32(p + 20);
+        return width > 0 && height > 0;
+    }
+
+    if (!isJpeg(bytes)) return false;
+
+    // JPEG: walk the marker segments up to the first SOFn
+    size_t pos = 2;
+    while (pos + 4 <= n) {
+        if (p[pos] != 0xFF) return false;
+        uchar marker = p[pos + 1];
+        if (marker == 0xFF) { pos++; continue; }                                   // fill byte
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) { pos += 2; continue; } // no length
+        if (marker == 0xD9 || marker == 0xDA) return false;                       // EOI / SOS before SOF
+
+        int length = be16(p + pos + 2);
+        bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (sof) {
+            if (pos + 9 > n) return false;
+            height = be16(p + pos + 5);
+            width = be16(p + pos + 7);
+            return width > 0 && height > 0;
+        }
+        pos += 2 + (size_t)length;
+    }
+    return false;
+}
+
+int chooseDecodeScale(int width, int height, size_t min_pixels)
+{
+    for (int scale = 8; scale > 1; scale /= 2) {
+        if ((size_t)(width / scale) * (size_t)(height / scale) >= min_pixels) {
+            return scale;
+        }
+    }
+    return 1;
+}
+
+Mat decodeAtScale(const vector<uchar>& bytes, int scale)
+{
+    int flags = IMREAD_COLOR;
+    if (isJpeg(bytes)) {
+        if (scale == 2) flags = IMREAD_REDUCED_COLOR_2;
+        else if (scale == 4) flags = IMREAD_REDUCED_COLOR_4;
+        else if (scale == 8) flags = IMREAD_REDUCED_COLOR_8;
+    }
+    return imdecode(bytes, flags);
+}
+
+Mat decodeReduced(const vector<uchar>& bytes, size_t min_pixels, int& scale, bool use_dc)
+{
+    int width = 0, height = 0;
+    scale = 1;
+    if (use_dc && isJpeg(bytes)) {
+        Mat dc = decodeJpegDcImage(bytes);
+        if (!dc.empty()) {
+            scale = 8;
+            return dc;
+        }
+    }
+    if (min_pixels > 0 && isJpeg(bytes) && readImageSize(bytes, width, height)) {
+        scale = chooseDecodeScale(width, height, min_pixels);
+    }
+    return decodeAtScale(bytes, scale);
+}
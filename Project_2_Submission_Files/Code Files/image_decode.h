@@ -0,0 +1,29 @@
+// image_decode.h
+#ifndef IMAGE_DECODE_H
+#define IMAGE_DECODE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+bool readFileBytes(const std::string& path, std::vector<uchar>& bytes);
+
+// Width and height from the JPEG SOF or PNG IHDR header, without decoding; false if unknown
+bool readImageSize(const std::vector<uchar>& bytes, int& width, int& height);
+bool isJpeg(const std::vector<uchar>& bytes);
+
+// Largest scale in {8, 4, 2} whose (width/scale) * (height/scale) still has min_pixels, else 1
+int chooseDecodeScale(int width, int height, size_t min_pixels);
+
+// imdecode at 1/scale (scale 1, 2, 4 or 8). Only JPEG is reduced during decode (DCT scaling);
+// for other formats OpenCV would decode in full and resize, so they are decoded at scale 1.
+cv::Mat decodeAtScale(const std::vector<uchar>& bytes, int scale);
+
+// Decodes at the cheapest scale that keeps min_pixels pixels; scale receives the scale used.
+// With use_dc a JPEG is reduced to its 8x8 block averages straight from the DCT coefficients
+// (decodeJpegDcImage, scale 8) when libjpeg-turbo support is built in.
+cv::Mat decodeReduced(const std::vector<uchar>& bytes, size_t min_pixels, int& scale, bool use_dc = false);
+
+
+#endif
@@ -0,0 +1,287 @@
+// image_features.cpp
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include "image_features.h"
+#include "jpeg_fast_decode.h"
+#include "fused_features.h"
+#include "histogram_kernels.h"
+#include "integral_histogram.h"
+#include "spatial_pyramid.h"
+
+using namespace cv;
+using namespace std;
+namespace fs = std::filesystem;
+
+// Function to compute the 7x7 square feature vector
+vector<float> computeFeature(const Mat& image)
+{
+    int row_start = image.rows / 2 - 3;  // This is the center row of the image
+    int col_start = image.cols / 2 - 3;  // This is the center column of the image
+
+    vector<float> features;
+    for (int i = row_start; i < row_start + 7; ++i)
+    {
+        for (int j = col_start; j < col_start + 7; ++j)
+        {
+            features.push_back(image.at<uchar>(i, j));
+        }
+    }
+    return features; // Returns the 7x7 feature vector
+}
+
+// Function to compute a 2D color histogram using rg chromaticity
+vector<float> computeHistogram(const Mat& image, int bins)
+{
+    // If image is not present, give error message
+    if (image.empty())
+    {
+        cerr << "Error: Image is empty!" << endl;
+        return {};
+    }
+
+    // 8-bit BGR: bin straight from the pixel bytes (histogram_kernels.cpp), no float planes
+    if (image.type() == CV_8UC3)
+    {
+        RgChromaticityCounter counter(bins);
+        counter.addImage(image.data, image.rows, image.cols, image.step);
+        vector<uint32_t> counts(bins * bins);
+        counter.counts(counts.data());
+        return normalizeCountsL1(counts.data(), bins * bins);
+    }
+
+    // Convert image to float and split into RGB channels
+    Mat float_img;
+    image.convertTo(float_img, CV_32F);  // Convert to float for division
+
+    vector<Mat> channels(3);
+    split(float_img, channels);
+
+    // RGB Color space
+    Mat r = channels[2];  // Red channel
+    Mat g = channels[1];  // Green channel
+    Mat b = channels[0];  // Blue channel
+
+    // Compute rg chromaticity
+    Mat sum_rgb = r + g + b + 1e-6;  // Avoid division by zero
+    Mat r_norm = r / sum_rgb;
+    Mat g_norm = g / sum_rgb;
+
+    // Define histogram parameters
+    int histSize[] = { bins, bins };
+    float r_range[] = { 0, 1 };
+    float g_range[] = { 0, 1 };
+    const float* ranges[] = { r_range, g_range };
+    int channelsArray[] = { 0, 1 };
+
+    Mat hist;
+    Mat rg_planes[] = { r_norm, g_norm };
+    calcHist(rg_planes, 2, channelsArray, Mat(), hist, 2, histSize, ranges, true, false);
+
+    // Normalize histogram (sum of all bins = 1)
+    normalize(hist, hist, 1, 0, NORM_L1);
+
+    // Flatten histogram into a vector
+    vector<float> hist_vector;
+    hist_vector.assign((float*)hist.datastart, (float*)hist.dataend);
+
+    return hist_vector;
+}
+
+// Function to compute a 3D RGB histogram of a region
+Mat computeRegionHistogram(const Mat& image, Rect region, int bins)
+{
+    // Variables
+    Mat hist;
+    Mat roi = image(region);  // Extract region of interest (ROI)
+
+    int histSize[] = { bins, bins, bins };   // Number of bins
+    float range[] = { 0, 256 };              // Range of pixel values
+    const float* histRange[] = { range, range, range };
+    int channels[] = { 0, 1, 2 };            // Channels
+
+    calcHist(&roi, 1, channels, Mat(), hist, 3, histSize, histRange, true, false);
+    normalize(hist, hist, 1, 0, NORM_L1);    // Normalize the histogram (for histogram intersection)
+
+    return hist;
+}
+
+// Upper 2/3 of the image
+Rect upperRegion(const Mat& image)
+{
+    return Rect(0, 0, image.cols, (2 * image.rows) / 3);
+}
+
+// Lower 2/3 of the image
+Rect lowerRegion(const Mat& image)
+{
+    return Rect(0, image.rows / 3, image.cols, (2 * image.rows) / 3);
+}
+
+vector<float> computeUpperRegionHistogram(const Mat& image)
+{
+    Mat hist = computeRegionHistogram(image, upperRegion(image));
+    return vector<float>((const float*)hist.datastart, (const float*)hist.dataend);
+}
+
+vector<float> computeLowerRegionHistogram(const Mat& image)
+{
+    Mat hist = computeRegionHistogram(image, lowerRegion(image));
+    return vector<float>((const float*)hist.datastart, (const float*)hist.dataend);
+}
+
+// Function to compute the HSV color histogram (flattened 30x32x32 bins)
+vector<float> getColorHistogram(const Mat& image)
+{
+    // 8-bit BGR: bin straight from the pixels with OpenCV's integer HSV math, no HSV image (histogram_kernels.cpp)
+    if (!image.empty() && image.type() == CV_8UC3) {
+        HsvBinCounter counter;
+        for (int y = 0; y < image.rows; y++) {
+            counter.addRow(image.ptr<uchar>(y), image.cols);
+        }
+        vector<uint32_t> counts(HsvBinCounter::H_BINS * HsvBinCounter::S_BINS * HsvBinCounter::V_BINS);
+        counter.counts(counts.data());
+        return normalizeCountsBySum(counts.data(), (int)counts.size());
+    }
+
+    Mat hsv;
+    cvtColor(image, hsv, COLOR_BGR2HSV);
+
+    int hBins = 30, sBins = 32, vBins = 32;
+    int histSize[] = { hBins, sBins, vBins };
+    float hRanges[] = { 0, 180 }, sRanges[] = { 0, 256 }, vRanges[] = { 0, 256 };
+    const float* ranges[] = { hRanges, sRanges, vRanges };
+    int channels[] = { 0, 1, 2 };
+
+    Mat hist;
+    calcHist(&hsv, 1, channels, Mat(), hist, 3, histSize, ranges, true, false);
+
+    // hist is a 3D Mat, so walk its continuous data rather than rows/cols
+    const float* bins = (const float*)hist.datastart;
+    size_t n = hist.total();
+
+    double histSum = 0;
+    for (size_t i = 0; i < n; i++) {
+        histSum += bins[i];
+    }
+
+    vector<float> histogram(n);
+    for (size_t i = 0; i < n; i++) {
+        histogram[i] = bins[i] / histSum;
+    }
+    return histogram;
+}
+
+// Function to compute the Sobel gradient magnitude histogram
+vector<float> getTextureHistogram(const Mat& image)
+{
+    // 8-bit BGR: gray rows stream through the fused Sobel magnitude counter (histogram_kernels.cpp)
+    if (!image.empty() && image.type() == CV_8UC3) {
+        SobelMagnitudeCounter counter(image.rows, image.cols);
+        for (int y = 0; y < image.rows; y++) {
+            counter.addBgrRow(image.ptr<uchar>(y));
+        }
+        uint32_t counts[256];
+        counter.counts(counts);
+        return normalizeCountsBySum(counts, 256);
+    }
+
+    Mat gray;
+    cvtColor(image, gray, COLOR_BGR2GRAY);
+
+    Mat sobelX, sobelY;
+    Sobel(gray, sobelX, CV_32F, 1, 0, 3);
+    Sobel(gray, sobelY, CV_32F, 0, 1, 3);
+
+    Mat magnitude;
+    magnitude = Mat::zeros(sobelX.size(), CV_32F);
+    for (int i = 0; i < sobelX.rows; i++) {
+        for (int j = 0; j < sobelX.cols; j++) {
+            magnitude.at<float>(i, j) = sqrt(sobelX.at<float>(i, j) * sobelX.at<float>(i, j) + sobelY.at<float>(i, j) * sobelY.at<float>(i, j));
+        }
+    }
+
+    vector<float> histogram;
+    int histSize = 256;
+    float range[] = { 0, 256 };
+    const float* histRange = { range };
+
+    Mat hist;
+    calcHist(&magnitude, 1, 0, Mat(), hist, 1, &histSize, &histRange, true, false);
+
+    double histSum = 0;
+    for (int i = 0; i < hist.rows; i++) {
+        histSum += hist.at<float>(i);
+    }
+    for (int i = 0; i < hist.rows; i++) {
+        histogram.push_back(hist.at<float>(i) / histSum);
+    }
+
+    return histogram;
+}
+
+static vector<float> computeDefaultHistogram(const Mat& image)
+{
+    return computeHistogram(image);
+}
+
+// Names double as the feature store file names inside the index directory
+const vector<FeatureExtractor>& featureExtractors()
+{
+    static const vector<FeatureExtractor> extractors = {
+        { "baseline_7x7", computeFeature, false, jpegCenterFeature, 0 },
+        { "rg_chromaticity", computeDefaultHistogram, true, nullptr, FUSED_RG_CHROMATICITY },
+        { "rgb_upper", computeUpperRegionHistogram, true, nullptr, FUSED_RGB_UPPER },
+        { "rgb_lower", computeLowerRegionHistogram, true, nullptr, FUSED_RGB_LOWER },
+        { "hsv_color", getColorHistogram, true, nullptr, FUSED_HSV_COLOR },
+        { "sobel_texture", getTextureHistogram, false, nullptr, FUSED_SOBEL_TEXTURE },  // gradient magnitudes change with resolution
+        { "rgb_integral", computeIntegralHistogramFeature, true, nullptr, 0 },          // integral_histogram.h layout
+        { "rgb_pyramid", computeDefaultSpatialPyramid, true, nullptr, 0 },              // defaultSpatialPyramid()
+    };
+    return extractors;
+}
+
+const FeatureExtractor* findFeatureExtractor(const string& name)
+{
+    for (const auto& extractor : featureExtractors()) {
+        if (name == extractor.name) return &extractor;
+    }
+    return nullptr;
+}
+
+int listImageFiles(const string& directory, vector<string>& paths)
+{
+    try
+    {
+        for (const auto& entry : fs::directory_iterator(directory))
+        {
+            if (entry.is_regular_file())
+            {
+                paths.push_back(entry.path().string());
+            }
+        }
+    }
+    catch (const fs::filesystem_error& ex)
+    {
+        cerr << "Error accessing directory: " << ex.what() << endl;
+        return 1;
+    }
+    sort(paths.begin(), paths.end());
+    return 0;
+}
+
+string featureIndexPath(const string& index_dir, const string& feature_name)
+{
+    return (fs::path(index_dir) / (feature_name + ".fst")).string();
+}
+
+// Opens one feature of an index; returns 1 without complaining if the index was never built
+int openFeatureIndex(const string& index_dir, const string& feature_name, FeatureStore& store)
+{
+    string path = featureIndexPath(index_dir, feature_name);
+    if (!fs::exists(path)) {
+        return 1;
+    }
+    return open_feature_store(path.c_str(), store);
+}
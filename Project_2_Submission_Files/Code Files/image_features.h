@@ -0,0 +1,49 @@
+// image_features.h
+#ifndef IMAGE_FEATURES_H
+#define IMAGE_FEATURES_H
+
+#include <vector>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "feature_store.h"
+
+// Task 1: 7x7 square at the center of the image
+std::vector<float> computeFeature(const cv::Mat& image);
+
+// Task 2: 2D rg-chromaticity histogram, L1 normalized
+std::vector<float> computeHistogram(const cv::Mat& image, int bins = 16);
+
+// Task 3: 3D RGB histogram of a region, L1 normalized, and the upper/lower 2/3 bands it is used on
+cv::Mat computeRegionHistogram(const cv::Mat& image, cv::Rect region, int bins = 8);
+cv::Rect upperRegion(const cv::Mat& image);
+cv::Rect lowerRegion(const cv::Mat& image);
+std::vector<float> computeUpperRegionHistogram(const cv::Mat& image);
+std::vector<float> computeLowerRegionHistogram(const cv::Mat& image);
+
+// Task 4: 30x32x32 HSV color histogram and 256-bin Sobel magnitude histogram, both L1 normalized
+std::vector<float> getColorHistogram(const cv::Mat& image);
+std::vector<float> getTextureHistogram(const cv::Mat& image);
+
+// Every feature the offline indexer stores, one feature store per entry.
+// scaleInvariant features are normalized histograms that may be extracted from a reduced-resolution decode.
+// extractEncoded, if set, computes the feature straight from the file bytes and returns empty when the
+// image has to be decoded instead. fused is the feature's FUSED_* bit in computeFusedFeatures, or 0.
+struct FeatureExtractor {
+    const char* name;
+    std::vector<float> (*extract)(const cv::Mat& image);
+    bool scaleInvariant;
+    std::vector<float> (*extractEncoded)(const std::vector<uchar>& bytes);
+    int fused;
+};
+
+const std::vector<FeatureExtractor>& featureExtractors();
+const FeatureExtractor* findFeatureExtractor(const std::string& name);
+
+// Regular files of directory in sorted (stable) order; returns 1 on filesystem errors
+int listImageFiles(const std::string& directory, std::vector<std::string>& paths);
+
+std::string featureIndexPath(const std::string& index_dir, const std::string& feature_name);
+int openFeatureIndex(const std::string& index_dir, const std::string& feature_name, FeatureStore& store);
+
+
+#endif
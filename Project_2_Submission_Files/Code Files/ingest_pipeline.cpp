@@ -0,0 +1,287 @@
+// ingest_pipeline.cpp
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include "ingest_pipeline.h"
+#include "bounded_queue.h"
+#include "feature_store.h"
+#include "image_decode.h"
+#include "fused_features.h"
+
+using namespace cv;
+using namespace std;
+namespace fs = std::filesystem;
+
+static const size_t END_OF_STREAM = (size_t)-1;
+
+// reader -> decoders
+struct EncodedFile {
+    size_t index = END_OF_STREAM;
+    vector<uchar> bytes;
+};
+
+// shared by the extractor workers of all features; the last one to finish releases the pixels
+struct DecodedImage {
+    size_t index = 0;
+    Mat image;        // full resolution, for features that are not scale invariant
+    Mat reduced;      // 1/scale resolution, for scale-invariant features
+    int scale = 1;
+    vector<vector<float>> encoded;  // features already computed from the file bytes or the fused pass
+    atomic<int> pending{ 0 };
+};
+
+// decoders -> extractor workers
+struct DecodedRef {
+    size_t index = END_OF_STREAM;
+    shared_ptr<DecodedImage> image;
+};
+
+// extractor workers (and decoders, for unreadable files) -> writer
+struct FeatureResult {
+    size_t index = END_OF_STREAM;
+    int feature = -1; // -1: the file could not be read or decoded
+    int scale = 1;
+    vector<float> values;
+};
+
+int runIngestPipeline(const vector<string>& paths, const vector<FeatureExtractor>& extractors,
+                      const string& index_dir, const PipelineOptions& options)
+{
+    const int numFeatures = (int)extractors.size();
+    if (numFeatures == 0) return 0;
+    const int numDecoders = options.decoders > 0 ? options.decoders : (int)max(1u, thread::hardware_concurrency());
+    const int workersPerFeature = max(1, options.workers_per_feature);
+    const size_t maxInFlight = options.max_in_flight > 0 ? options.max_in_flight : 2 * (size_t)numDecoders;
+
+    BoundedQueue<EncodedFile> readQueue(options.queue_capacity);
+    vector<unique_ptr<BoundedQueue<DecodedRef>>> featureQueues;
+    for (int f = 0; f < numFeatures; f++) {
+        featureQueues.emplace_back(new BoundedQueue<DecodedRef>(options.queue_capacity));
+    }
+    BoundedQueue<FeatureResult> writeQueue(options.queue_capacity * max(1, numFeatures));
+
+    atomic<size_t> nextIndex{ 0 };  // first row the writer has not written yet
+    atomic<int> liveDecoders{ numDecoders };
+    atomic<int> liveWorkers{ numFeatures * workersPerFeature };
+
+    // scale-invariant features read the reduced decode whenever one was asked for
+    vector<bool> onFull(numFeatures), onReduced(numFeatures);
+    for (int f = 0; f < numFeatures; f++) {
+        onReduced[f] = (options.min_pixels > 0 || options.dct_dc) && extractors[f].scaleInvariant;
+        onFull[f] = !onReduced[f];
+    }
+
+    // Stage 1: file reader
+    thread reader([&] {
+        for (size_t i = 0; i < paths.size(); i++) {
+            EncodedFile file;
+            file.index = i;
+            if (!readFileBytes(paths[i], file.bytes)) {
+                file.bytes.clear(); // the decoder reports it as skipped
+            }
+            readQueue.push(move(file));
+        }
+        for (int d = 0; d < numDecoders; d++) {
+            readQueue.push(EncodedFile());
+        }
+    });
+
+    // Stage 2: decoders, throttled by the in-flight cap: a file is only decoded once it is within maxInFlight
+    // rows of the writer, which bounds both the decoded images and the rows waiting in the writer's reorder
+    // buffer. The oldest unwritten row can always go ahead, so a slow image cannot deadlock the window.
+    vector<thread> decoders;
+    for (int d = 0; d < numDecoders; d++) {
+        decoders.emplace_back([&] {
+            for (;;) {
+                EncodedFile file;
+                readQueue.pop(file);
+                if (file.index == END_OF_STREAM) break;
+
+                for (unsigned spins = 0; file.index - nextIndex.load() >= maxInFlight; spins++) {
+                    BoundedQueue<EncodedFile>::backoff(spins);
+                }
+
+                shared_ptr<DecodedImage> decoded = make_shared<DecodedImage>();
+                decoded->index = file.index;
+                decoded->encoded.resize(numFeatures);
+                bool readable = !file.bytes.empty();
+                bool needFull = false, needReduced = false;
+                for (int f = 0; f < numFeatures; f++) {
+                    if (extractors[f].extractEncoded && readable) {
+                        decoded->encoded[f] = extractors[f].extractEncoded(file.bytes);
+                    }
+                    if (decoded->encoded[f].empty()) {
+                        needReduced |= onReduced[f];
+                        needFull |= onFull[f];
+                    }
+                }
+                if (readable) {
+                    if (needReduced) {
+                        decoded->reduced = decodeReduced(file.bytes, options.min_pixels, decoded->scale, options.dct_dc);
+                    }
+                    if (needFull) {
+                        decoded->image = (needReduced && decoded->scale == 1) ? decoded->reduced : imdecode(file.bytes, IMREAD_COLOR);
+                    }
+
+                    // histograms sharing an image are computed here in one fused pass
+                    if (needFull && !decoded->image.empty()) {
+                        extractFusedFeatures(decoded->image, extractors, onFull, decoded->encoded);
+                    }
+                    if (needReduced && !decoded->reduced.empty()) {
+                        extractFusedFeatures(decoded->reduced, extractors, onReduced, decoded->encoded);
+                    }
+                }
+                vector<uchar>().swap(file.bytes);
+
+                if (!readable || (needFull && decoded->image.empty()) || (needReduced && decoded->reduced.empty())) {
+                    FeatureResult skipped;
+                    skipped.index = file.index;
+                    writeQueue.push(move(skipped));
+                    continue;
+                }
+
+                decoded->pending = numFeatures;
+                for (int f = 0; f < numFeatures; f++) {
+                    DecodedRef ref;
+                    ref.index = file.index;
+                    ref.image = decoded;
+                    featureQueues[f]->push(move(ref));
+                }
+            }
+
+            // the last decoder out tells every extractor worker to stop
+            if (--liveDecoders == 0) {
+                for (int f = 0; f < numFeatures; f++) {
+                    for (int w = 0; w < workersPerFeature; w++) {
+                        featureQueues[f]->push(DecodedRef());
+                    }
+                }
+            }
+        });
+    }
+
+    // Stage 3: extractor workers, one group per feature
+    vector<thread> workers;
+    for (int f = 0; f < numFeatures; f++) {
+        for (int w = 0; w < workersPerFeature; w++) {
+            workers.emplace_back([&, f] {
+                for (;;) {
+                    DecodedRef ref;
+                    featureQueues[f]->pop(ref);
+                    if (ref.index == END_OF_STREAM) break;
+
+                    const bool reduced = onReduced[f];
+                    FeatureResult result;
+                    result.index = ref.index;
+                    result.feature = f;
+                    result.scale = reduced ? ref.image->scale : 1;
+                    if (!ref.image->encoded[f].empty()) {
+                        result.scale = 1;
+                        result.values = move(ref.image->encoded[f]);
+                    }
+                    else {
+                        result.values = extractors[f].extract(reduced ? ref.image->reduced : ref.image->image);
+                    }
+
+                    if (--ref.image->pending == 0) {
+                        ref.image->image.release();
+                        ref.image->reduced.release();
+                    }
+                    ref.image.reset();
+                    writeQueue.push(move(result));
+                }
+
+                // the last worker out ends the writer's stream
+                if (--liveWorkers == 0) {
+                    writeQueue.push(FeatureResult());
+                }
+            });
+        }
+    }
+
+    // Stage 4: single writer on this thread, emitting rows in path order
+    struct PendingRow {
+        int remaining = 0;
+        bool skipped = false;
+        vector<vector<float>> values;
+        vector<int> scales;
+    };
+    map<size_t, PendingRow> pending;  // at most maxInFlight rows, see the decoders
+    size_t written = 0;
+    int err = 0;
+
+    vector<unique_ptr<FeatureStoreWriter>> stores;
+    vector<size_t> dims(numFeatures, 0);
+    for (int f = 0; f < numFeatures; f++) {
+        stores.emplace_back(new FeatureStoreWriter());
+    }
+
+    for (;;) {
+        FeatureResult result;
+        writeQueue.pop(result);
+        if (result.index == END_OF_STREAM) break;
+
+        PendingRow& row = pending[result.index];
+        if (row.values.empty()) {
+            row.values.resize(numFeatures);
+            row.scales.resize(numFeatures, 1);
+            row.remaining = numFeatures;
+        }
+        if (result.feature < 0) {
+            row.skipped = true;
+            row.remaining = 0;
+        }
+        else {
+            row.values[result.feature] = move(result.values);
+            row.scales[result.feature] = result.scale;
+            row.remaining--;
+        }
+
+        // flush every row that is complete and next in line
+        for (auto it = pending.begin(); it != pending.end() && it->first == nextIndex && it->second.remaining == 0; it = pending.begin()) {
+            if (!it->second.skipped && !err) {
+                string filename = fs::path(paths[nextIndex]).filename().string();
+                for (int f = 0; f < numFeatures; f++) {
+                    const vector<float>& values = it->second.values[f];
+                    if (stores[f]->rows() == 0 && dims[f] == 0) {
+                        dims[f] = values.size();
+                        string storePath = featureIndexPath(index_dir, extractors[f].name);
+                        err |= stores[f]->open(storePath.c_str(), dims[f]);
+                    }
+                    if (values.size() != dims[f]) {
+                        cerr << "Error: " << extractors[f].name << " of " << paths[nextIndex] << " has " << values.size()
+                             << " values, expected " << dims[f] << endl;
+                        err = 1;
+                        break;
+                    }
+                    err |= stores[f]->append(filename, values.data(), it->second.scales[f]);
+                }
+                if (++written % 100 == 0) {
+                    cout << "Indexed " << written << " images" << endl;
+                }
+            }
+            pending.erase(it);
+            nextIndex++;  // lets the decoders take the next file
+        }
+    }
+
+    reader.join();
+    for (auto& t : decoders) t.join();
+    for (auto& t : workers) t.join();
+
+    for (int f = 0; f < numFeatures; f++) {
+        if (stores[f]->rows() == 0 && dims[f] == 0) {
+            string storePath = featureIndexPath(index_dir, extractors[f].name);
+            err |= stores[f]->open(storePath.c_str(), 0); // no images: still leave an empty store behind
+        }
+        cout << "Wrote " << stores[f]->rows() << " x " << dims[f] << " " << extractors[f].name << endl;
+        err |= stores[f]->close();
+    }
+
+    return err ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+// ingest_pipeline.h
+#ifndef INGEST_PIPELINE_H
+#define INGEST_PIPELINE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "image_features.h"
+
+struct PipelineOptions {
+    int decoders = 0;             // decoder threads, 0 = one per core
+    int workers_per_feature = 1;  // extractor threads per feature
+    size_t max_in_flight = 0;     // images between decode and write at once, 0 = 2 * decoders
+    size_t queue_capacity = 64;   // slots of each queue between two stages
+    size_t min_pixels = 0;        // > 0: scale-invariant features use a reduced JPEG decode keeping this many pixels
+    bool dct_dc = false;          // scale-invariant features use the JPEG DC-coefficient image (1/8 scale)
+};
+
+/*
+ * Staged ingestion: one reader thread loads file bytes, a decoder pool runs imdecode, every feature
+ * has its own extractor workers and the calling thread is the single writer. Stages are connected by
+ * bounded lock-free queues, so disk, decode and feature math overlap. An image is only decoded once it is
+ * within max_in_flight rows of the writer, so at most that many decoded images and rows waiting to be
+ * written exist at any time. Rows are written in path order to one feature store per extractor in index_dir.
+ * The function returns 0 on success and 1 on error.
+ */
+int runIngestPipeline(const std::vector<std::string>& paths, const std::vector<FeatureExtractor>& extractors,
+                      const std::string& index_dir, const PipelineOptions& options);
+
+
+#endif
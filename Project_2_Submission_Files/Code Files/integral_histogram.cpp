@@ -0,0 +1,128 @@
+// integral_histogram.cpp
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include "integral_histogram.h"
+#include "histogram_kernels.h"
+
+using namespace cv;
+using namespace std;
+
+vector<int> gridCellOfPixel(int length, int cells)
+{
+    vector<int> cell(length);
+    for (int k = 0; k < cells; k++) {
+        int begin = (int)((int64_t)k * length / cells);
+        int end = (int)((int64_t)(k + 1) * length / cells);
+        for (int i = begin; i < end; i++) cell[i] = k;
+    }
+    return cell;
+}
+
+int computeIntegralHistogram(const Mat& image, IntegralHistogram& integral, int gridRows, int gridCols, int bins)
+{
+    if (image.empty() || image.type() != CV_8UC3) return 1;
+
+    integral.gridRows = gridRows;
+    integral.gridCols = gridCols;
+    integral.bins = bins;
+    const int binCount = integral.binCount();
+
+    // bin of every byte value, floor(v * bins / 256) as calcHist over [0, 256)
+    int binOf[256];
+    for (int v = 0; v < 256; v++) binOf[v] = (v * bins) >> 8;
+
+    vector<int> rowCell = gridCellOfPixel(image.rows, gridRows);
+    vector<int> colCell = gridCellOfPixel(image.cols, gridCols);
+
+    vector<uint32_t> cells((size_t)gridRows * gridCols * binCount, 0);
+    for (int y = 0; y < image.rows; y++) {
+        const uchar* p = image.ptr<uchar>(y);
+        uint32_t* cellRow = &cells[(size_t)rowCell[y] * gridCols * binCount];
+        for (int x = 0; x < image.cols; x++, p += 3) {
+            int bin = (binOf[p[0]] * bins + binOf[p[1]]) * bins + binOf[p[2]];
+            cellRow[(size_t)colCell[x] * binCount + bin]++;
+        }
+    }
+
+    // corner (r, c) = corner (r - 1, c) + running sum of cell row r - 1 up to column c
+    const int cornerCols = gridCols + 1;
+    integral.corners.assign((size_t)(gridRows + 1) * cornerCols * binCount, 0.0f);
+    vector<double> running(binCount);
+    for (int r = 1; r <= gridRows; r++) {
+        fill(running.begin(), running.end(), 0.0);
+        for (int c = 1; c <= gridCols; c++) {
+            const uint32_t* cell = &cells[((size_t)(r - 1) * gridCols + (c - 1)) * binCount];
+            const float* above = &integral.corners[((size_t)(r - 1) * cornerCols + c) * binCount];
+            float* corner = &integral.corners[((size_t)r * cornerCols + c) * binCount];
+            for (int b = 0; b < binCount; b++) {
+                running[b] += cell[b];
+                corner[b] = (float)(above[b] + running[b]);
+            }
+        }
+    }
+    return 0;
+}
+
+vector<float> computeIntegralHistogramFeature(const Mat& image)
+{
+    IntegralHistogram integral;
+    if (computeIntegralHistogram(image, integral) != 0) return vector<float>();
+    return integral.corners;
+}
+
+void integralRegionHistogram(const float* corners, int gridRows, int gridCols, int bins,
+                             int row0, int col0, int row1, int col1, float* hist)
+{
+    const int binCount = bins * bins * bins;
+    const int cornerCols = gridCols + 1;
+    row0 = max(0, min(row0, gridRows));
+    row1 = max(0, min(row1, gridRows));
+    col0 = max(0, min(col0, gridCols));
+    col1 = max(0, min(col1, gridCols));
+
+    const float* a = corners + ((size_t)row0 * cornerCols + col0) * binCount;
+    const float* b = corners + ((size_t)row0 * cornerCols + col1) * binCount;
+    const float* c = corners + ((size_t)row1 * cornerCols + col0) * binCount;
+    const float* d = corners + ((size_t)row1 * cornerCols + col1) * binCount;
+
+    // counts are integers, exact in float up to 2^24 pixels per corner; normalized as normalizeCountsL1 does
+    double total = 0;
+    for (int i = 0; i < binCount; i++) {
+        double count = (double)d[i] - b[i] - c[i] + a[i];
+        hist[i] = (float)(count > 0 ? (uint32_t)llround(count) : 0);
+        total += hist[i];
+    }
+    float scale = (float)(total > DBL_EPSILON ? 1.0 / total : 0.0);
+    for (int i = 0; i < binCount; i++) hist[i] *= scale;
+}
+
+vector<float> integralRegionHistogram(const float* corners, int gridRows, int gridCols, int bins,
+                                      int row0, int col0, int row1, int col1)
+{
+    vector<float> hist((size_t)bins * bins * bins);
+    integralRegionHistogram(corners, gridRows, gridCols, bins, row0, col0, row1, col1, hist.data());
+    return hist;
+}
+
+vector<float> integralRegionHistogram(const IntegralHistogram& integral, int row0, int col0, int row1, int col1)
+{
+    return integralRegionHistogram(integral.corners.data(), integral.gridRows, integral.gridCols, integral.bins,
+                                   row0, col0, row1, col1);
+}
+
+static void snapRange(int begin, int length, int size, int cells, int& first, int& last)
+{
+    first = (int)lround((double)begin * cells / size);
+    last = (int)lround((double)(begin + length) * cells / size);
+    first = max(0, min(first, cells - 1));
+    last = max(first + 1, min(last, cells));
+}
+
+void snapRegionToCells(const Rect& region, const Size& imageSize, int gridRows, int gridCols,
+                       int& row0, int& col0, int& row1, int& col1)
+{
+    snapRange(region.y, region.height, imageSize.height, gridRows, row0, row1);
+    snapRange(region.x, region.width, imageSize.width, gridCols, col0, col1);
+}
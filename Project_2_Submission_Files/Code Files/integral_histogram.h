@@ -0,0 +1,51 @@
+// integral_histogram.h
+#ifndef INTEGRAL_HISTOGRAM_H
+#define INTEGRAL_HISTOGRAM_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Layout stored by the indexer as the "rgb_integral" feature
+const int INTEGRAL_GRID_ROWS = 6;  // multiples of 3 keep the Task 3 bands on cell boundaries
+const int INTEGRAL_GRID_COLS = 6;
+const int INTEGRAL_BINS = 8;       // per channel, as computeRegionHistogram
+
+/*
+ * Integral histogram of the 3D RGB histogram over a coarse grid: corner (r, c) holds the bin counts of
+ * all pixels above and left of grid line r, c. Grid line k lies at pixel k * rows / gridRows. The histogram
+ * of any block of cells then costs four corner lookups per bin, so new region layouts and ROI queries
+ * need no re-decode. Regions snap to cell boundaries.
+ */
+struct IntegralHistogram {
+    int gridRows = INTEGRAL_GRID_ROWS;
+    int gridCols = INTEGRAL_GRID_COLS;
+    int bins = INTEGRAL_BINS;
+    std::vector<float> corners;  // (gridRows + 1) x (gridCols + 1) x bins^3 counts
+
+    int binCount() const { return bins * bins * bins; }
+};
+
+// Grid cell of every pixel row (or column) when length pixels are split into cells: line k sits at k * length / cells
+std::vector<int> gridCellOfPixel(int length, int cells);
+
+// Returns 1 if the image is not 8-bit BGR
+int computeIntegralHistogram(const cv::Mat& image, IntegralHistogram& integral,
+                             int gridRows = INTEGRAL_GRID_ROWS, int gridCols = INTEGRAL_GRID_COLS, int bins = INTEGRAL_BINS);
+
+// Flattened corners, the indexer's extractor
+std::vector<float> computeIntegralHistogramFeature(const cv::Mat& image);
+
+// L1-normalized histogram of cells [row0, row1) x [col0, col1) from corners laid out as above, written to
+// hist (bins^3 floats) without allocating, for scoring every row of an index
+void integralRegionHistogram(const float* corners, int gridRows, int gridCols, int bins,
+                             int row0, int col0, int row1, int col1, float* hist);
+std::vector<float> integralRegionHistogram(const float* corners, int gridRows, int gridCols, int bins,
+                                           int row0, int col0, int row1, int col1);
+std::vector<float> integralRegionHistogram(const IntegralHistogram& integral, int row0, int col0, int row1, int col1);
+
+// Snaps a pixel rectangle of an imageSize image to the grid cells that cover the most of it
+void snapRegionToCells(const cv::Rect& region, const cv::Size& imageSize, int gridRows, int gridCols,
+                       int& row0, int& col0, int& row1, int& col1);
+
+
+#endif
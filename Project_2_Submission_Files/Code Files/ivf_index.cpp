@@ -0,0 +1,235 @@
+// ivf_index.cpp
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "ivf_index.h"
+#include "distance_kernels.h"
+#include "kmeans.h"
+#include "top_k.h"
+
+static const uint64_t IVF_ALIGNMENT = 64;
+
+/*
+ * Checks the lists of a mapped index before it is searched: the offsets start at 0, never go back and end at
+ * rows, and every id names a row, so a search only reads entries and store rows that exist.
+ */
+static bool lists_are_valid(const uint64_t* offsets, const uint32_t* ids, uint64_t nlist, uint64_t rows) {
+    if (offsets[0] != 0 || offsets[nlist] != rows) return false;
+    for (uint64_t l = 0; l < nlist; l++) {
+        if (offsets[l + 1] < offsets[l]) return false;
+    }
+    for (uint64_t j = 0; j < rows; j++) {
+        if (ids[j] >= rows) return false;
+    }
+    return true;
+}
+
+IvfIndex::IvfIndex()
+    : centroids(nullptr), list_offsets(nullptr), ids(nullptr), vectors(nullptr), count(0), cols(0), nlist(0) {
+}
+
+IvfIndex::~IvfIndex() {
+    close();
+}
+
+void IvfIndex::set_views() {
+    centroids = centroid_data.data();
+    list_offsets = list_offset_table.data();
+    ids = list_ids.data();
+    vectors = list_vectors.data();
+}
+
+int IvfIndex::build(WorkStealingPool& pool, const float* data, size_t rows, size_t dim, size_t stride,
+                    const IvfParams& params) {
+    close();
+    if (rows >= UINT32_MAX) {
+        fprintf(stderr, "IVF index needs fewer than 2^32 rows\n");
+        return 1;
+    }
+
+    count = rows;
+    cols = dim;
+    nlist = params.nlist ? params.nlist : (size_t)std::lround(4 * std::sqrt((double)rows));
+    nlist = std::max<size_t>(1, std::min(nlist, rows));
+    if (rows == 0) nlist = 0;
+
+    // a seeded sample of the rows; its first nlist entries are the initial centroids
+    size_t ntrain = std::min(rows, nlist * std::max<size_t>(1, params.max_train_per_list));
+    std::vector<uint32_t> sample(rows);
+    for (size_t i = 0; i < rows; i++) sample[i] = (uint32_t)i;
+    std::mt19937_64 rng(params.seed);
+    for (size_t i = 0; i < ntrain; i++) {
+        std::swap(sample[i], sample[i + (size_t)(rng() % (rows - i))]);
+    }
+    sample.resize(ntrain);
+
+    centroid_data.resize(nlist * dim);
+    for (size_t c = 0; c < nlist; c++) {
+        std::copy(data + sample[c] * stride, data + sample[c] * stride + dim, &centroid_data[c * dim]);
+    }
+
+    // the training rows, contiguous and in row order
+    std::sort(sample.begin(), sample.end());
+    std::vector<float> train(ntrain * dim);
+    for (size_t i = 0; i < ntrain; i++) {
+        std::copy(data + sample[i] * stride, data + sample[i] * stride + dim, &train[i * dim]);
+    }
+    train_kmeans(pool, train.data(), ntrain, dim, nlist, params.iterations, centroid_data);
+    std::vector<float>().swap(train);
+
+    // every row into the list of its nearest centroid; each list's vectors are copied next to each other
+    std::vector<uint32_t> assignment;
+    assign_rows(pool, data, rows, stride, centroid_data.data(), nlist, dim, assignment);
+    group_by_cluster(assignment, nlist, list_offset_table, list_ids);
+    list_vectors.resize(rows * dim);
+    pool.parallel_for(nlist, [&](size_t l) {
+        for (uint64_t j = list_offset_table[l]; j < list_offset_table[l + 1]; j++) {
+            const float* v = data + (size_t)list_ids[j] * stride;
+            std::copy(v, v + dim, &list_vectors[j * dim]);
+        }
+    });
+    set_views();
+    return 0;
+}
+
+int IvfIndex::save(const char* filename) const {
+    if (!list_offsets) {
+        fprintf(stderr, "No IVF index to save; build or open one first\n");
+        return 1;
+    }
+
+    IvfHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IVF_MAGIC, sizeof(IVF_MAGIC));
+    header.version = IVF_VERSION;
+    header.rows = count;
+    header.dim = cols;
+    header.nlist = nlist;
+
+    uint64_t centroid_bytes = nlist * cols * sizeof(float);
+    uint64_t offset_bytes = (nlist + 1) * sizeof(uint64_t);
+    uint64_t id_bytes = count * sizeof(uint32_t);
+    uint64_t vector_bytes = count * cols * sizeof(float);
+    header.centroids_offset = align_up(sizeof(header), IVF_ALIGNMENT);
+    header.list_offsets_offset = align_up(header.centroids_offset + centroid_bytes, IVF_ALIGNMENT);
+    header.ids_offset = align_up(header.list_offsets_offset + offset_bytes, IVF_ALIGNMENT);
+    header.vectors_offset = align_up(header.ids_offset + id_bytes, IVF_ALIGNMENT);
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("Unable to open IVF index for writing");
+        return 1;
+    }
+
+    int err = fwrite(&header, sizeof(header), 1, fp) != 1;
+    err |= write_padding(fp, sizeof(header), header.centroids_offset);
+    if (centroid_bytes > 0) {
+        err |= fwrite(centroids, 1, (size_t)centroid_bytes, fp) != centroid_bytes;
+    }
+    err |= write_padding(fp, header.centroids_offset + centroid_bytes, header.list_offsets_offset);
+    err |= fwrite(list_offsets, 1, (size_t)offset_bytes, fp) != offset_bytes;
+    err |= write_padding(fp, header.list_offsets_offset + offset_bytes, header.ids_offset);
+    if (id_bytes > 0) {
+        err |= fwrite(ids, 1, (size_t)id_bytes, fp) != id_bytes;
+    }
+    err |= write_padding(fp, header.ids_offset + id_bytes, header.vectors_offset);
+    if (vector_bytes > 0) {
+        err |= fwrite(vectors, 1, (size_t)vector_bytes, fp) != vector_bytes;
+    }
+    err |= fclose(fp) != 0;
+
+    if (err) {
+        fprintf(stderr, "Error writing IVF index %s\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+int IvfIndex::open(const char* filename) {
+    close();
+    if (map_file_readonly(filename, file)) {
+        return 1;
+    }
+
+    IvfHeader header;
+    if (file.size < sizeof(header)) {
+        fprintf(stderr, "IVF index %s is truncated\n", filename);
+        close();
+        return 1;
+    }
+    memcpy(&header, file.data, sizeof(header));
+
+    if (memcmp(header.magic, IVF_MAGIC, sizeof(IVF_MAGIC)) != 0 || header.version != IVF_VERSION) {
+        fprintf(stderr, "%s is not an IVF index (or has an unsupported version)\n", filename);
+        close();
+        return 1;
+    }
+
+    // every section aligned and inside the file; written so that a corrupt header cannot overflow the sums
+    const uint64_t size = file.size;
+    const uint64_t row_floats = header.dim ? header.dim : 1;
+    bool ok = header.nlist <= header.rows && (header.nlist == 0) == (header.rows == 0) && header.rows < UINT32_MAX &&
+              header.centroids_offset % IVF_ALIGNMENT == 0 && header.list_offsets_offset % IVF_ALIGNMENT == 0 &&
+              header.ids_offset % IVF_ALIGNMENT == 0 && header.vectors_offset % IVF_ALIGNMENT == 0 &&
+              header.centroids_offset <= size &&
+              header.nlist <= (size - header.centroids_offset) / sizeof(float) / row_floats &&
+              header.list_offsets_offset <= size && header.nlist < (size - header.list_offsets_offset) / sizeof(uint64_t) &&
+              header.ids_offset <= size && header.rows <= (size - header.ids_offset) / sizeof(uint32_t) &&
+              header.vectors_offset <= size && header.rows <= (size - header.vectors_offset) / sizeof(float) / row_floats;
+    const uint64_t* offsets = (const uint64_t*)(file.data + header.list_offsets_offset);
+    ok = ok && lists_are_valid(offsets, (const uint32_t*)(file.data + header.ids_offset), header.nlist, header.rows);
+    if (!ok) {
+        fprintf(stderr, "IVF index %s is corrupt\n", filename);
+        close();
+        return 1;
+    }
+
+    centroids = (const float*)(file.data + header.centroids_offset);
+    list_offsets = offsets;
+    ids = (const uint32_t*)(file.data + header.ids_offset);
+    vectors = (const float*)(file.data + header.vectors_offset);
+    count = (size_t)header.rows;
+    cols = (size_t)header.dim;
+    nlist = (size_t)header.nlist;
+    return 0;
+}
+
+void IvfIndex::close() {
+    unmap_file(file);
+    centroid_data.clear();
+    list_offset_table.clear();
+    list_ids.clear();
+    list_vectors.clear();
+    centroids = nullptr;
+    list_offsets = nullptr;
+    ids = nullptr;
+    vectors = nullptr;
+    count = cols = nlist = 0;
+}
+
+std::vector<std::pair<float, size_t>> IvfIndex::search(const float* query, size_t k, size_t nprobe,
+                                                       const std::function<bool(size_t)>& skipRow) const {
+    if (count == 0 || k == 0) return std::vector<std::pair<float, size_t>>();
+
+    // the nprobe lists whose centroids are nearest
+    nprobe = std::max<size_t>(1, std::min(nprobe, nlist));
+    std::vector<std::pair<float, uint32_t>> closest(nlist);
+    for (size_t c = 0; c < nlist; c++) {
+        closest[c] = std::make_pair(ssdDistance(query, centroids + c * cols, cols), (uint32_t)c);
+    }
+    std::partial_sort(closest.begin(), closest.begin() + nprobe, closest.end());
+
+    // stream through each list; once k rows are kept, the k-th distance bounds the rest
+    TopK<float> top(k);
+    for (size_t p = 0; p < nprobe; p++) {
+        const uint32_t l = closest[p].second;
+        for (uint64_t j = list_offsets[l]; j < list_offsets[l + 1]; j++) {
+            if (skipRow && skipRow(ids[j])) continue;
+            float bound = top.full() ? top.threshold() : INFINITY;
+            top.push(ssdDistanceBounded(query, vectors + j * cols, cols, bound), ids[j]);
+        }
+    }
+    return top.sorted();
+}
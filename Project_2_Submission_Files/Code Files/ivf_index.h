@@ -0,0 +1,104 @@
+// ivf_index.h
+#ifndef IVF_INDEX_H
+#define IVF_INDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+/*
+ * Inverted-file (IVF) index: k-means splits the vectors into nlist partitions, and a query only scans the
+ * nprobe partitions whose centroids are closest to it. nprobe is the recall / latency knob: nprobe = nlist
+ * is an exact scan. Every partition's vectors are copied next to each other in list order, so a probe
+ * streams through one contiguous block; the index is self-contained and does not need the feature store.
+ *
+ * On disk (.ivf), in native (little-endian) byte order, every section 64-byte aligned:
+ *
+ *   IvfHeader
+ *   float centroids[nlist][dim]
+ *   uint64_t list_offsets[nlist + 1]  list l holds entries [list_offsets[l], list_offsets[l + 1])
+ *   uint32_t ids[rows]                feature store row of every entry, in list order
+ *   float vectors[rows][dim]          the vectors, in list order
+ */
+#define IVF_MAGIC "CBIRIVF"
+#define IVF_VERSION 1
+
+struct IvfHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t rows;
+    uint64_t dim;
+    uint64_t nlist;
+    uint64_t centroids_offset;
+    uint64_t list_offsets_offset;
+    uint64_t ids_offset;
+    uint64_t vectors_offset;
+};
+
+struct IvfParams {
+    size_t nlist = 0;                     // partitions; 0 = 4 * sqrt(rows)
+    size_t iterations = 20;               // k-means (Lloyd) iterations
+    size_t max_train_per_list = 256;      // k-means trains on at most nlist * this many sampled rows
+    uint64_t seed = 100;                  // sample and initial centroids
+};
+
+class IvfIndex {
+public:
+    IvfIndex();
+    ~IvfIndex();
+
+    /*
+     * Trains the centroids on a sample of the rows vectors of dim floats (row i at data + i * stride), assigns
+     * every row to its nearest centroid and copies the rows into their lists. Training and assignment run on
+     * all workers of the pool; the result does not depend on the thread count.
+     * The function returns 0 on success and 1 on error.
+     */
+    int build(WorkStealingPool& pool, const float* data, size_t rows, size_t dim, size_t stride, const IvfParams& params);
+
+    // Writes the index; returns 0 on success and 1 on error
+    int save(const char* filename) const;
+
+    // Maps a saved index; nothing is copied, and the lists and ids are checked once. Returns 0 on success and 1 on error.
+    int open(const char* filename);
+    void close();
+
+    /*
+     * The k nearest rows of query by SSD among the nprobe closest lists, best first, as (SSD, row) with ties
+     * ordered by row. skipRow, if given, leaves rows out of the results.
+     */
+    std::vector<std::pair<float, size_t>> search(const float* query, size_t k, size_t nprobe,
+                                                 const std::function<bool(size_t)>& skipRow = nullptr) const;
+
+    size_t rows() const { return count; }
+    size_t dim() const { return cols; }
+    size_t lists() const { return nlist; }
+
+private:
+    IvfIndex(const IvfIndex&) = delete;
+    IvfIndex& operator=(const IvfIndex&) = delete;
+
+    void set_views();
+
+    MappedFile file;
+    std::vector<float> centroid_data;
+    std::vector<uint64_t> list_offset_table;
+    std::vector<uint32_t> list_ids;
+    std::vector<float> list_vectors;
+
+    const float* centroids;
+    const uint64_t* list_offsets;
+    const uint32_t* ids;
+    const float* vectors;
+
+    size_t count;
+    size_t cols;
+    size_t nlist;
+};
+
+
+#endif
@@ -0,0 +1,277 @@
+// jpeg_fast_decode.cpp
+#include <algorithm>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include "jpeg_fast_decode.h"
+#include "image_features.h"
+
+#ifdef CBIR_WITH_LIBJPEG_TURBO
+#include <jpeglib.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+#ifdef CBIR_WITH_LIBJPEG_TURBO
+
+// libjpeg's default error handler calls exit(); jump back to the caller instead
+struct JpegErrorManager {
+    jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+    JpegErrorManager* err = (JpegErrorManager*)cinfo->err;
+    longjmp(err->setjmp_buffer, 1);
+}
+
+static void jpegSilentMessage(j_common_ptr, int)
+{
+}
+
+static uchar clampToByte(double v)
+{
+    return (uchar)std::min(255.0, std::max(0.0, std::floor(v + 0.5)));
+}
+
+// Orientation tag of the EXIF APP1 segment, 1 (upright) if there is none
+static int exifOrientation(jpeg_saved_marker_ptr marker)
+{
+    for (; marker; marker = marker->next) {
+        const JOCTET* p = marker->data;
+        unsigned len = marker->data_length;
+        if (marker->marker != JPEG_APP0 + 1 || len < 14 || memcmp(p, "Exif\0\0", 6) != 0) continue;
+
+        const JOCTET* tiff = p + 6;
+        unsigned size = len - 6;
+        bool little = tiff[0] == 'I';
+        auto read16 = [&](unsigned at) { return little ? tiff[at] | tiff[at + 1] << 8 : tiff[at] << 8 | tiff[at + 1]; };
+        auto read32 = [&](unsigned at) {
+            return little ? (unsigned)read16(at) | (unsigned)read16(at + 2) << 16 : (unsigned)read16(at) << 16 | (unsigned)read16(at + 2);
+        };
+
+        // ifd comes from the file: compare against what is left so a huge offset cannot wrap past the checks
+        if (size < 8) return 1;
+        unsigned ifd = read32(4);
+        if (ifd > size - 2) return 1;
+        unsigned count = read16(ifd);
+        unsigned fit = (size - ifd - 2) / 12; // whole entries inside the segment
+        for (unsigned e = 0; e < count && e < fit; e++) {
+            unsigned entry = ifd + 2 + 12 * e;
+            if (read16(entry) == 0x0112) return read16(entry + 8);
+        }
+        return 1;
+    }
+    return 1;
+}
+
+int decodeJpegDcBgr(const uchar* data, size_t size, vector<uchar>& bgr, int& width, int& height)
+{
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager jerr;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpegErrorExit;
+    jerr.pub.emit_message = jpegSilentMessage;
+
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return 1;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data, (unsigned long)size);
+    jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_read_header(&cinfo, TRUE);
+
+    // imread rotates by the EXIF orientation; position-dependent features have to see the same layout,
+    // so rotated files are left to the normal decode
+    int ncomp = cinfo.num_components;
+    bool supported = (ncomp == 1 && cinfo.jpeg_color_space == JCS_GRAYSCALE) ||
+                     (ncomp == 3 && (cinfo.jpeg_color_space == JCS_YCbCr || cinfo.jpeg_color_space == JCS_RGB));
+    if (!supported || exifOrientation(cinfo.marker_list) != 1) {
+        jpeg_destroy_decompress(&cinfo);
+        return 1;
+    }
+
+    jvirt_barray_ptr* coefs = jpeg_read_coefficients(&cinfo);
+
+    // one output pixel per 8x8 block of the full-resolution image
+    width = (int)((cinfo.image_width + 7) / 8);
+    height = (int)((cinfo.image_height + 7) / 8);
+    bgr.assign((size_t)width * height * 3, 0);
+
+    int hmax = cinfo.max_h_samp_factor;
+    int vmax = cinfo.max_v_samp_factor;
+
+    // mean sample value of every block of every component: DC * q0 / 8 + 128. The tables come from
+    // libjpeg's image pool, which jpeg_destroy_decompress frees after an error too; a C++ container
+    // created after setjmp would skip its destructor when an error longjmps past it
+    float* means[3];
+    int blocksWide[3], blocksHigh[3];
+    for (int c = 0; c < ncomp; c++) {
+        jpeg_component_info* comp = &cinfo.comp_info[c];
+        blocksWide[c] = (int)comp->width_in_blocks;
+        blocksHigh[c] = (int)comp->height_in_blocks;
+        means[c] = (float*)(*cinfo.mem->alloc_large)((j_common_ptr)&cinfo, JPOOL_IMAGE,
+                                                     (size_t)blocksWide[c] * blocksHigh[c] * sizeof(float));
+
+        double q0 = comp->quant_table ? comp->quant_table->quantval[0] : 1;
+        for (int by = 0; by < blocksHigh[c]; by++) {
+            JBLOCKARRAY rows = (*cinfo.mem->access_virt_barray)((j_common_ptr)&cinfo, coefs[c], (JDIMENSION)by, 1, FALSE);
+            for (int bx = 0; bx < blocksWide[c]; bx++) {
+                means[c][(size_t)by * blocksWide[c] + bx] = (float)(rows[0][bx][0] * q0 / 8.0 + 128.0);
+            }
+        }
+    }
+
+    // pick, for every output block, the (possibly subsampled) block of each component covering it
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            double v[3];
+            for (int c = 0; c < ncomp; c++) {
+                jpeg_component_info* comp = &cinfo.comp_info[c];
+                int cx = std::min(x * comp->h_samp_factor / hmax, blocksWide[c] - 1);
+                int cy = std::min(y * comp->v_samp_factor / vmax, blocksHigh[c] - 1);
+                v[c] = means[c][(size_t)cy * blocksWide[c] + cx];
+            }
+
+            uchar* p = &bgr[((size_t)y * width + x) * 3];
+            if (ncomp == 1) {
+                p[0] = p[1] = p[2] = clampToByte(v[0]);
+            }
+            else if (cinfo.jpeg_color_space == JCS_RGB) {
+                p[0] = clampToByte(v[2]);
+                p[1] = clampToByte(v[1]);
+                p[2] = clampToByte(v[0]);
+            }
+            else {
+                // JFIF YCbCr -> RGB
+                double yy = v[0], cb = v[1] - 128.0, cr = v[2] - 128.0;
+                p[0] = clampToByte(yy + 1.772 * cb);
+                p[1] = clampToByte(yy - 0.344136 * cb - 0.714136 * cr);
+                p[2] = clampToByte(yy + 1.402 * cr);
+            }
+        }
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return 0;
+}
+
+int decodeJpegCenterPatch(const uchar* data, size_t size, vector<float>& features)
+{
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager jerr;
+    vector<uchar> rows;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpegErrorExit;
+    jerr.pub.emit_message = jpegSilentMessage;
+
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return 1;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data, (unsigned long)size);
+    jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_read_header(&cinfo, TRUE);
+
+    // imread rotates by the EXIF orientation and converts CMYK itself; leave those to it
+    if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK ||
+        exifOrientation(cinfo.marker_list) != 1) {
+        jpeg_destroy_decompress(&cinfo);
+        return 1;
+    }
+
+    cinfo.out_color_space = JCS_EXT_BGR;  // same byte layout as the CV_8UC3 Mat imread returns
+    jpeg_start_decompress(&cinfo);
+
+    int imageRows = (int)cinfo.output_height;
+    int imageCols = (int)cinfo.output_width;
+    if (imageRows < 7 || imageCols < 7) {
+        jpeg_destroy_decompress(&cinfo);
+        return 1;
+    }
+
+    // computeFeature reads image.at<uchar>(i, j): bytes col_start..col_start+6 of each BGR row
+    int row_start = imageRows / 2 - 3;
+    int col_start = imageCols / 2 - 3;
+    int firstPixel = col_start / 3;
+    int lastPixel = (col_start + 6) / 3;
+
+    // one pixel of margin keeps fancy upsampling at the crop edges identical to a full decode
+    JDIMENSION xoffset = (JDIMENSION)max(0, firstPixel - 1);
+    JDIMENSION width = (JDIMENSION)(min(imageCols - 1, lastPixel + 1) + 1) - xoffset;
+    jpeg_crop_scanline(&cinfo, &xoffset, &width);
+
+    jpeg_skip_scanlines(&cinfo, (JDIMENSION)row_start);
+    size_t stride = (size_t)cinfo.output_width * 3;  // cropped width
+    rows.resize(stride * 7);
+    for (int r = 0; r < 7; r++) {
+        JSAMPROW line = &rows[stride * r];
+        if (jpeg_read_scanlines(&cinfo, &line, 1) != 1) {
+            jpeg_destroy_decompress(&cinfo);
+            return 1;
+        }
+    }
+
+    features.clear();
+    features.reserve(49);
+    size_t firstByte = (size_t)xoffset * 3;
+    for (int r = 0; r < 7; r++) {
+        for (int j = col_start; j < col_start + 7; j++) {
+            features.push_back(rows[stride * r + j - firstByte]);
+        }
+    }
+
+    jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return 0;
+}
+
+#else
+
+int decodeJpegDcBgr(const uchar*, size_t, vector<uchar>&, int&, int&)
+{
+    return 1; // built without libjpeg-turbo
+}
+
+int decodeJpegCenterPatch(const uchar*, size_t, vector<float>&)
+{
+    return 1;
+}
+
+#endif
+
+Mat decodeJpegDcImage(const vector<uchar>& bytes)
+{
+    vector<uchar> bgr;
+    int width = 0, height = 0;
+    if (bytes.empty() || decodeJpegDcBgr(bytes.data(), bytes.size(), bgr, width, height) != 0) {
+        return Mat();
+    }
+    return Mat(height, width, CV_8UC3, bgr.data()).clone();
+}
+
+vector<float> jpegCenterFeature(const vector<uchar>& bytes)
+{
+    vector<float> features;
+    if (bytes.empty() || decodeJpegCenterPatch(bytes.data(), bytes.size(), features) != 0) {
+        return vector<float>();
+    }
+    return features;
+}
+
+vector<float> computeFeatureFromBytes(const vector<uchar>& bytes)
+{
+    vector<float> features = jpegCenterFeature(bytes);
+    if (!features.empty()) return features;
+
+    Mat image = bytes.empty() ? Mat() : imdecode(bytes, IMREAD_COLOR);
+    return image.empty() ? vector<float>() : computeFeature(image);
+}
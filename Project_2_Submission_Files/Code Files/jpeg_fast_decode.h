@@ -0,0 +1,31 @@
+// jpeg_fast_decode.h
+#ifndef JPEG_FAST_DECODE_H
+#define JPEG_FAST_DECODE_H
+
+#include <cstddef>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/*
+ * JPEG shortcuts built on libjpeg-turbo. They are compiled in when CBIR_WITH_LIBJPEG_TURBO is defined
+ * (link with -ljpeg); otherwise every function reports failure and callers fall back to imdecode.
+ */
+
+// Builds a 1/8-scale BGR image (one pixel per 8x8 block of the full image) from the DC coefficients,
+// read with jpeg_read_coefficients: no inverse DCT, no upsampling, no color conversion of full-size planes.
+// Returns 1 if the data is not a YCbCr, RGB or grayscale JPEG, or has an EXIF orientation other than 1
+// (imread would rotate it, so the caller decodes it normally).
+int decodeJpegDcBgr(const uchar* data, size_t size, std::vector<uchar>& bgr, int& width, int& height);
+cv::Mat decodeJpegDcImage(const std::vector<uchar>& bytes);
+
+// computeFeature (7x7 center patch) of the image imread would return, decoding only the MCU rows and
+// columns around the center with jpeg_skip_scanlines / jpeg_crop_scanline. Returns 1, so the caller can
+// decode in full, for non-JPEG data, CMYK files, EXIF orientations other than 1 and images under 7x7.
+int decodeJpegCenterPatch(const uchar* data, size_t size, std::vector<float>& features);
+std::vector<float> jpegCenterFeature(const std::vector<uchar>& bytes);  // empty on fallback
+
+// computeFeature of the encoded image: center patch decode, else imdecode; empty if not an image
+std::vector<float> computeFeatureFromBytes(const std::vector<uchar>& bytes);
+
+
+#endif
@@ -0,0 +1,86 @@
+// kmeans.cpp
+#include <algorithm>
+#include <cmath>
+#include "kmeans.h"
+#include "distance_kernels.h"
+
+static const size_t ASSIGN_BLOCK = 1024; // rows per assignment task
+
+// the best distance so far lets the remaining centroids be abandoned early
+uint32_t nearest_centroid(const float* v, const float* centroids, size_t k, size_t dim) {
+    uint32_t best = 0;
+    float best_distance = INFINITY;
+    for (size_t c = 0; c < k; c++) {
+        float d = ssdDistanceBounded(v, centroids + c * dim, dim, best_distance);
+        if (d < best_distance) {
+            best_distance = d;
+            best = (uint32_t)c;
+        }
+    }
+    return best;
+}
+
+void assign_rows(WorkStealingPool& pool, const float* data, size_t rows, size_t stride, const float* centroids,
+                 size_t k, size_t dim, std::vector<uint32_t>& assignment) {
+    assignment.resize(rows);
+    pool.parallel_for((rows + ASSIGN_BLOCK - 1) / ASSIGN_BLOCK, [&](size_t block) {
+        const size_t end = std::min(rows, (block + 1) * ASSIGN_BLOCK);
+        for (size_t i = block * ASSIGN_BLOCK; i < end; i++) {
+            assignment[i] = nearest_centroid(data + i * stride, centroids, k, dim);
+        }
+    });
+}
+
+void group_by_cluster(const std::vector<uint32_t>& assignment, size_t k, std::vector<uint64_t>& offsets,
+                      std::vector<uint32_t>& order) {
+    offsets.assign(k + 1, 0);
+    for (uint32_t c : assignment) {
+        offsets[c + 1]++;
+    }
+    for (size_t c = 0; c < k; c++) {
+        offsets[c + 1] += offsets[c];
+    }
+    std::vector<uint64_t> next(offsets.begin(), offsets.end() - 1);
+    order.resize(assignment.size());
+    for (size_t i = 0; i < assignment.size(); i++) {
+        order[next[assignment[i]]++] = (uint32_t)i;
+    }
+}
+
+void train_kmeans(WorkStealingPool& pool, const float* train, size_t ntrain, size_t dim, size_t k,
+                  size_t iterations, std::vector<float>& centroids) {
+    std::vector<uint32_t> assignment, previous, order;
+    std::vector<uint64_t> offsets;
+    for (size_t it = 0; it < iterations; it++) {
+        assign_rows(pool, train, ntrain, dim, centroids.data(), k, dim, assignment);
+        if (assignment == previous) break;
+
+        group_by_cluster(assignment, k, offsets, order);
+        pool.parallel_for(k, [&](size_t c) {
+            if (offsets[c] == offsets[c + 1]) return;
+            std::vector<double> sum(dim, 0.0);
+            for (uint64_t j = offsets[c]; j < offsets[c + 1]; j++) {
+                const float* v = train + (size_t)order[j] * dim;
+                for (size_t d = 0; d < dim; d++) sum[d] += v[d];
+            }
+            double n = (double)(offsets[c + 1] - offsets[c]);
+            for (size_t d = 0; d < dim; d++) centroids[c * dim + d] = (float)(sum[d] / n);
+        });
+
+        std::vector<uint64_t> sizes(k);
+        for (size_t c = 0; c < k; c++) sizes[c] = offsets[c + 1] - offsets[c];
+        for (size_t c = 0; c < k; c++) {
+            if (sizes[c] != 0) continue;
+            size_t largest = std::max_element(sizes.begin(), sizes.end()) - sizes.begin();
+            const float eps = 1.0f / 1024;
+            for (size_t d = 0; d < dim; d++) {
+                float sign = (d % 2 == 0) ? 1.0f : -1.0f;
+                centroids[c * dim + d] = centroids[largest * dim + d] * (1 + sign * eps);
+                centroids[largest * dim + d] *= 1 - sign * eps;
+            }
+            sizes[c] = sizes[largest] / 2;
+            sizes[largest] -= sizes[c];
+        }
+        previous.swap(assignment);
+    }
+}
@@ -0,0 +1,36 @@
+// kmeans.h
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "thread_pool.h"
+
+/*
+ * k-means helpers shared by the IVF partitions and the product-quantization codebooks. Vectors are dim
+ * floats and centroids are k contiguous rows of dim floats; distances are SSD.
+ */
+
+// Index of the centroid nearest to v
+uint32_t nearest_centroid(const float* v, const float* centroids, size_t k, size_t dim);
+
+// assignment[i] = nearest centroid of row i (at data + i * stride), on all workers of the pool
+void assign_rows(WorkStealingPool& pool, const float* data, size_t rows, size_t stride, const float* centroids,
+                 size_t k, size_t dim, std::vector<uint32_t>& assignment);
+
+// Counting sort of the rows by cluster: order[offsets[c]..offsets[c + 1]) are the rows of cluster c, ascending
+void group_by_cluster(const std::vector<uint32_t>& assignment, size_t k, std::vector<uint64_t>& offsets,
+                      std::vector<uint32_t>& order);
+
+/*
+ * Lloyd's k-means over ntrain contiguous rows; centroids holds the k initial centroids and receives the
+ * trained ones. The means are summed in double in row order, so the result does not depend on the thread
+ * count. An empty cluster takes over half of the largest one: it gets a copy of that centroid and both are
+ * nudged apart, as faiss does.
+ */
+void train_kmeans(WorkStealingPool& pool, const float* train, size_t ntrain, size_t dim, size_t k,
+                  size_t iterations, std::vector<float>& centroids);
+
+
+#endif
@@ -0,0 +1,116 @@
+// mapped_file.cpp
+#include <cstdio>
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Maps the whole file read-only. An empty file maps successfully with data == nullptr.
+ * The function returns 0 on success and 1 on error.
+ */
+int map_file_readonly(const char* filename, MappedFile& mf) {
+    mf = MappedFile();
+
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        return 1;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fh, &size)) {
+        fprintf(stderr, "Unable to stat %s\n", filename);
+        CloseHandle(fh);
+        return 1;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(fh);
+        return 0;
+    }
+
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mh) {
+        fprintf(stderr, "Unable to map %s\n", filename);
+        CloseHandle(fh);
+        return 1;
+    }
+
+    void* p = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (!p) {
+        fprintf(stderr, "Unable to map %s\n", filename);
+        CloseHandle(mh);
+        CloseHandle(fh);
+        return 1;
+    }
+
+    mf.data = (const char*)p;
+    mf.size = (size_t)size.QuadPart;
+    mf.file_handle = fh;
+    mf.map_handle = mh;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Unable to open file for mapping");
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("Unable to stat file for mapping");
+        close(fd);
+        return 1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file
+    if (p == MAP_FAILED) {
+        perror("Unable to map file");
+        return 1;
+    }
+
+    mf.data = (const char*)p;
+    mf.size = (size_t)st.st_size;
+#endif
+
+    return 0;
+}
+
+void unmap_file(MappedFile& mf) {
+    if (mf.data) {
+#ifdef _WIN32
+        UnmapViewOfFile(mf.data);
+        CloseHandle((HANDLE)mf.map_handle);
+        CloseHandle((HANDLE)mf.file_handle);
+#else
+        munmap((void*)mf.data, mf.size);
+#endif
+    }
+    mf = MappedFile();
+}
+
+uint64_t align_up(uint64_t v, uint64_t a) {
+    return (v + a - 1) / a * a;
+}
+
+int write_padding(FILE* fp, uint64_t from, uint64_t to) {
+    static const char zeros[64] = { 0 };
+    for (uint64_t n = to - from; n > 0;) {
+        size_t chunk = n < sizeof(zeros) ? (size_t)n : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, fp) != chunk) return 1;
+        n -= chunk;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+// mapped_file.h
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+/*
+ * Read-only view of a whole file mapped into memory. The binary formats (.fst, .hnsw, .ivf, .pq) are
+ * written with fwrite and read back through such a view without parsing; the index classes keep either
+ * the arrays they built or the mapping they opened, and search through pointers into whichever they have.
+ */
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* map_handle = nullptr;
+#endif
+};
+
+int map_file_readonly(const char* filename, MappedFile& mf);
+void unmap_file(MappedFile& mf);
+
+// v rounded up to a multiple of a, for laying out the sections of a file
+uint64_t align_up(uint64_t v, uint64_t a);
+
+// Writes to - from zero bytes, the gap between two sections; returns 0 on success and 1 on error
+int write_padding(FILE* fp, uint64_t from, uint64_t to);
+
+
+#endif
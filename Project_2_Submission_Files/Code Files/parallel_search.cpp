@@ -0,0 +1,71 @@
+// parallel_search.cpp
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include "parallel_search.h"
+#include "distance_kernels.h"
+#include "feature_matrix.h"
+#include "top_k.h"
+
+using namespace std;
+
+size_t searchBlockRows(size_t rowBytes)
+{
+    const size_t BLOCK_BYTES = 256 * 1024;
+    return max<size_t>(1, BLOCK_BYTES / max<size_t>(1, rowBytes));
+}
+
+vector<pair<float, size_t>> parallelTopK(WorkStealingPool& pool, size_t n, size_t k, bool higherIsBetter,
+                                         size_t blockRows, const RowScorer& score)
+{
+    TopK<float> merged(k, higherIsBetter);
+    if (n == 0 || k == 0) return merged.sorted();
+
+    blockRows = max<size_t>(1, blockRows);
+    atomic<float> threshold(higherIsBetter ? -INFINITY : INFINITY);
+    vector<TopK<float>> local(pool.size(), TopK<float>(k, higherIsBetter));
+
+    pool.parallel_for((n + blockRows - 1) / blockRows, [&](size_t block)
+    {
+        TopK<float>& top = local[WorkStealingPool::current_worker()];
+        const size_t end = min(n, (block + 1) * blockRows);
+        for (size_t i = block * blockRows; i < end; i++) {
+            float s = score(i, threshold.load(memory_order_relaxed));
+            if (std::isnan(s) || !top.push(s, i) || !top.full()) continue;
+
+            // a full heap's k-th best bounds the global k-th best; publish it if it is tighter.
+            // Rows a scorer abandons against it are worse than k kept rows, so they never survive the merge.
+            float kth = top.threshold();
+            float shared = threshold.load(memory_order_relaxed);
+            while ((higherIsBetter ? kth > shared : kth < shared) &&
+                   !threshold.compare_exchange_weak(shared, kth, memory_order_relaxed)) {
+            }
+        }
+    });
+
+    for (const auto& top : local) merged.merge(top);
+    return merged.sorted();
+}
+
+// Row i at rows + i * stride
+static vector<pair<float, size_t>> ssdTopK(WorkStealingPool& pool, const float* query, const float* rows, size_t n,
+                                           size_t dim, size_t stride, size_t k, const function<bool(size_t)>& skipRow)
+{
+    return parallelTopK(pool, n, k, false, searchBlockRows(stride * sizeof(float)), [&](size_t i, float bound)
+    {
+        if (skipRow && skipRow(i)) return NAN;
+        return ssdDistanceBounded(query, rows + i * stride, dim, bound);
+    });
+}
+
+vector<pair<float, size_t>> parallelSsdTopK(WorkStealingPool& pool, const float* query, const float* rows,
+                                            size_t n, size_t dim, size_t k, const function<bool(size_t)>& skipRow)
+{
+    return ssdTopK(pool, query, rows, n, dim, dim, k, skipRow);
+}
+
+vector<pair<float, size_t>> parallelSsdTopK(WorkStealingPool& pool, const float* query, const FeatureMatrix& matrix,
+                                            size_t k, const function<bool(size_t)>& skipRow)
+{
+    return ssdTopK(pool, query, matrix.data(), matrix.rows(), matrix.dim(), matrix.stride(), k, skipRow);
+}
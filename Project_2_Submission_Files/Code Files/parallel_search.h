@@ -0,0 +1,43 @@
+// parallel_search.h
+#ifndef PARALLEL_SEARCH_H
+#define PARALLEL_SEARCH_H
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "thread_pool.h"
+
+class FeatureMatrix;
+
+/*
+ * Scores one row. bound is the k-th best score any worker has kept so far (+inf, or -inf when higher is
+ * better, until one has k rows): a scorer may stop as soon as its partial result is certain to be worse
+ * and return any value worse than bound. Returning NaN leaves the row out (e.g. the query image itself).
+ */
+typedef std::function<float(size_t row, float bound)> RowScorer;
+
+/*
+ * Exact top-k over rows [0, n) on all workers of the pool. The rows are cut into blocks of blockRows;
+ * every worker keeps its own top-k heap and publishes its k-th best score to a shared atomic threshold,
+ * which is what the scorers receive as bound. The heaps are merged at the end, best first, with ties
+ * ordered by row as TopK does, so the result does not depend on the thread count or timing.
+ */
+std::vector<std::pair<float, size_t>> parallelTopK(WorkStealingPool& pool, size_t n, size_t k, bool higherIsBetter,
+                                                   size_t blockRows, const RowScorer& score);
+
+// Rows of rowBytes each that fill about 256 KB (a block stays in L2 while it is scored)
+size_t searchBlockRows(size_t rowBytes);
+
+// SSD top-k over the contiguous rows of a feature matrix (row i at rows + i * dim), pruned by early abandoning.
+// skipRow, if given, leaves rows out.
+std::vector<std::pair<float, size_t>> parallelSsdTopK(WorkStealingPool& pool, const float* query, const float* rows,
+                                                      size_t n, size_t dim, size_t k,
+                                                      const std::function<bool(size_t)>& skipRow = nullptr);
+
+// The same over the rows of a FeatureMatrix; query holds matrix.dim() values
+std::vector<std::pair<float, size_t>> parallelSsdTopK(WorkStealingPool& pool, const float* query, const FeatureMatrix& matrix,
+                                                      size_t k, const std::function<bool(size_t)>& skipRow = nullptr);
+
+
+#endif
@@ -0,0 +1,369 @@
+// pq_index.cpp
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "pq_index.h"
+#include "distance_kernels.h"
+#include "kmeans.h"
+#include "simd_target.h"
+#include "top_k.h"
+
+static const uint64_t PQ_ALIGNMENT = 64;
+static const size_t PQ_MAX_M = 256;      // 256 * 255 still fits the 16-bit sums
+static const size_t ENCODE_BLOCKS = 32;  // code blocks per encoding task
+static const size_t SCAN_BLOCKS = 64;    // code blocks summed per kernel call (2048 rows)
+
+/*
+ * Fast-scan kernels: sums[b * 32 + j] = sum over q of lut[q][code of row j in block b], for nblocks blocks
+ * of m * 16 code bytes. The vector versions look up the 4-bit codes with byte shuffles and split the bytes
+ * into even and odd rows so they can be added as 16-bit lanes without overflowing.
+ */
+typedef void (*ScanFn)(const uint8_t* codes, size_t nblocks, size_t m, const uint8_t* lut, uint16_t* sums);
+
+static void scan_scalar(const uint8_t* codes, size_t nblocks, size_t m, const uint8_t* lut, uint16_t* sums) {
+    for (size_t b = 0; b < nblocks; b++) {
+        const uint8_t* block = codes + b * m * 16;
+        for (size_t j = 0; j < 16; j++) {
+            unsigned lo = 0, hi = 0;
+            for (size_t q = 0; q < m; q++) {
+                const uint8_t c = block[q * 16 + j];
+                lo += lut[q * 16 + (c & 15)];
+                hi += lut[q * 16 + (c >> 4)];
+            }
+            sums[b * PQ_BLOCK + j] = (uint16_t)lo;
+            sums[b * PQ_BLOCK + j + 16] = (uint16_t)hi;
+        }
+    }
+}
+
+#ifdef SIMD_X86
+
+// Writes the 16 rows held as even / odd 16-bit lanes back in row order
+TARGET("sse4.1") static inline void store_rows(uint16_t* out, __m128i even, __m128i odd) {
+    _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(even, odd));
+    _mm_storeu_si128((__m128i*)(out + 8), _mm_unpackhi_epi16(even, odd));
+}
+
+// One sub-quantizer (16 code bytes, one 16-entry table) per step
+TARGET("sse4.1") static void scan_sse41(const uint8_t* codes, size_t nblocks, size_t m, const uint8_t* lut, uint16_t* sums) {
+    const __m128i low4 = _mm_set1_epi8(0x0f);
+    const __m128i low8 = _mm_set1_epi16(0x00ff);
+    for (size_t b = 0; b < nblocks; b++) {
+        const uint8_t* block = codes + b * m * 16;
+        __m128i even_lo = _mm_setzero_si128(), odd_lo = _mm_setzero_si128();
+        __m128i even_hi = _mm_setzero_si128(), odd_hi = _mm_setzero_si128();
+        for (size_t q = 0; q < m; q++) {
+            const __m128i c = _mm_loadu_si128((const __m128i*)(block + q * 16));
+            const __m128i table = _mm_loadu_si128((const __m128i*)(lut + q * 16));
+            const __m128i d_lo = _mm_shuffle_epi8(table, _mm_and_si128(c, low4));
+            const __m128i d_hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(c, 4), low4));
+            even_lo = _mm_add_epi16(even_lo, _mm_and_si128(d_lo, low8));
+            odd_lo = _mm_add_epi16(odd_lo, _mm_srli_epi16(d_lo, 8));
+            even_hi = _mm_add_epi16(even_hi, _mm_and_si128(d_hi, low8));
+            odd_hi = _mm_add_epi16(odd_hi, _mm_srli_epi16(d_hi, 8));
+        }
+        store_rows(sums + b * PQ_BLOCK, even_lo, odd_lo);
+        store_rows(sums + b * PQ_BLOCK + 16, even_hi, odd_hi);
+    }
+}
+
+// Two sub-quantizers per step, one in each 128-bit lane; the lanes are added together at the end
+TARGET("avx2") static void scan_avx2(const uint8_t* codes, size_t nblocks, size_t m, const uint8_t* lut, uint16_t* sums) {
+    const __m256i low4 = _mm256_set1_epi8(0x0f);
+    const __m256i low8 = _mm256_set1_epi16(0x00ff);
+    for (size_t b = 0; b < nblocks; b++) {
+        const uint8_t* block = codes + b * m * 16;
+        __m256i even_lo = _mm256_setzero_si256(), odd_lo = _mm256_setzero_si256();
+        __m256i even_hi = _mm256_setzero_si256(), odd_hi = _mm256_setzero_si256();
+        for (size_t q = 0; q < m; q += 2) {
+            __m256i c, table;
+            if (q + 1 < m) {
+                c = _mm256_loadu_si256((const __m256i*)(block + q * 16));
+                table = _mm256_loadu_si256((const __m256i*)(lut + q * 16));
+            }
+            else {
+                // odd m: the upper lane looks up code 0 in an all-zero table
+                c = _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_loadu_si128((const __m128i*)(block + q * 16)), 0);
+                table = _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_loadu_si128((const __m128i*)(lut + q * 16)), 0);
+            }
+            const __m256i d_lo = _mm256_shuffle_epi8(table, _mm256_and_si256(c, low4));
+            const __m256i d_hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(c, 4), low4));
+            even_lo = _mm256_add_epi16(even_lo, _mm256_and_si256(d_lo, low8));
+            odd_lo = _mm256_add_epi16(odd_lo, _mm256_srli_epi16(d_lo, 8));
+            even_hi = _mm256_add_epi16(even_hi, _mm256_and_si256(d_hi, low8));
+            odd_hi = _mm256_add_epi16(odd_hi, _mm256_srli_epi16(d_hi, 8));
+        }
+        store_rows(sums + b * PQ_BLOCK,
+                   _mm_add_epi16(_mm256_castsi256_si128(even_lo), _mm256_extracti128_si256(even_lo, 1)),
+                   _mm_add_epi16(_mm256_castsi256_si128(odd_lo), _mm256_extracti128_si256(odd_lo, 1)));
+        store_rows(sums + b * PQ_BLOCK + 16,
+                   _mm_add_epi16(_mm256_castsi256_si128(even_hi), _mm256_extracti128_si256(even_hi, 1)),
+                   _mm_add_epi16(_mm256_castsi256_si128(odd_hi), _mm256_extracti128_si256(odd_hi, 1)));
+    }
+}
+
+#endif  // SIMD_X86
+
+// Follows the ISA the distance kernels picked, so CBIR_SIMD caps the scan as well
+static ScanFn select_scan() {
+#ifdef SIMD_X86
+    const char* isa = distanceKernelIsa();
+    if (!strcmp(isa, "avx512") || !strcmp(isa, "avx2")) return scan_avx2;
+    if (!strcmp(isa, "sse4.1")) return scan_sse41;
+#endif
+    return scan_scalar;
+}
+
+static void scan_blocks(const uint8_t* codes, size_t nblocks, size_t m, const uint8_t* lut, uint16_t* sums) {
+    static const ScanFn scan = select_scan();
+    scan(codes, nblocks, m, lut, sums);
+}
+
+PqIndex::PqIndex()
+    : codebooks(nullptr), codes(nullptr), vectors(nullptr), count(0), cols(0), stride(0), m(0), dsub(0) {
+}
+
+PqIndex::~PqIndex() {
+    close();
+}
+
+void PqIndex::set_views() {
+    codebooks = codebook_data.data();
+    codes = code_data.data();
+}
+
+int PqIndex::build(WorkStealingPool& pool, const float* data, size_t rows, size_t dim, size_t row_stride,
+                   const PqParams& params) {
+    close();
+    size_t subquantizers = params.m ? params.m : std::max<size_t>(1, dim / 8);
+    if (dim == 0 || subquantizers > std::min(dim, PQ_MAX_M)) {
+        fprintf(stderr, "PQ index needs 1 to min(%zu, dim) sub-quantizers\n", PQ_MAX_M);
+        return 1;
+    }
+
+    vectors = data;
+    count = rows;
+    cols = dim;
+    stride = row_stride;
+    m = subquantizers;
+    dsub = (dim + m - 1) / m;
+    const size_t padded = m * dsub;
+    const size_t codebook_size = PQ_CENTROIDS * dsub;
+    codebook_data.assign(m * codebook_size, 0.0f);
+
+    // a seeded sample of the rows, zero-padded to m * dsub; its first 16 entries are the initial centroids
+    size_t ntrain = std::min(rows, std::max<size_t>(PQ_CENTROIDS, params.max_train));
+    std::vector<uint32_t> sample(rows);
+    for (size_t i = 0; i < rows; i++) sample[i] = (uint32_t)i;
+    std::mt19937_64 rng(params.seed);
+    for (size_t i = 0; i < ntrain; i++) {
+        std::swap(sample[i], sample[i + (size_t)(rng() % (rows - i))]);
+    }
+    sample.resize(ntrain);
+
+    std::vector<float> initial(PQ_CENTROIDS * padded, 0.0f);
+    for (size_t c = 0; c < PQ_CENTROIDS && ntrain > 0; c++) {
+        const float* v = data + sample[c % ntrain] * row_stride;
+        std::copy(v, v + dim, &initial[c * padded]);
+    }
+
+    std::sort(sample.begin(), sample.end());
+    std::vector<float> train(ntrain * padded, 0.0f);
+    for (size_t i = 0; i < ntrain; i++) {
+        std::copy(data + sample[i] * row_stride, data + sample[i] * row_stride + dim, &train[i * padded]);
+    }
+
+    // one k-means per sub-quantizer over its slice of the sample
+    std::vector<float> sub(ntrain * dsub), centroids(codebook_size);
+    for (size_t q = 0; q < m && ntrain > 0; q++) {
+        for (size_t i = 0; i < ntrain; i++) {
+            std::copy(&train[i * padded + q * dsub], &train[i * padded + (q + 1) * dsub], &sub[i * dsub]);
+        }
+        for (size_t c = 0; c < PQ_CENTROIDS; c++) {
+            std::copy(&initial[c * padded + q * dsub], &initial[c * padded + (q + 1) * dsub], &centroids[c * dsub]);
+        }
+        train_kmeans(pool, sub.data(), ntrain, dsub, PQ_CENTROIDS, params.iterations, centroids);
+        std::copy(centroids.begin(), centroids.end(), &codebook_data[q * codebook_size]);
+    }
+    std::vector<float>().swap(train);
+
+    // every row's nearest centroids, packed two rows to a byte in blocks of 32 rows
+    const size_t nblocks = (rows + PQ_BLOCK - 1) / PQ_BLOCK;
+    code_data.assign(nblocks * m * 16, 0);
+    pool.parallel_for((nblocks + ENCODE_BLOCKS - 1) / ENCODE_BLOCKS, [&](size_t task) {
+        std::vector<float> v(padded, 0.0f);
+        const size_t end = std::min(rows, (task + 1) * ENCODE_BLOCKS * PQ_BLOCK);
+        for (size_t row = task * ENCODE_BLOCKS * PQ_BLOCK; row < end; row++) {
+            std::copy(data + row * row_stride, data + row * row_stride + dim, v.begin());
+            const size_t b = row / PQ_BLOCK, j = row % PQ_BLOCK;
+            for (size_t q = 0; q < m; q++) {
+                uint32_t c = nearest_centroid(&v[q * dsub], &codebook_data[q * codebook_size], PQ_CENTROIDS, dsub);
+                code_data[(b * m + q) * 16 + j % 16] |= (uint8_t)(j < 16 ? c : c << 4);
+            }
+        }
+    });
+    set_views();
+    return 0;
+}
+
+int PqIndex::save(const char* filename) const {
+    PqHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PQ_MAGIC, sizeof(PQ_MAGIC));
+    header.version = PQ_VERSION;
+    header.m = (uint32_t)m;
+    header.rows = count;
+    header.dim = cols;
+    header.dsub = dsub;
+
+    uint64_t codebook_bytes = m * PQ_CENTROIDS * dsub * sizeof(float);
+    uint64_t code_bytes = (count + PQ_BLOCK - 1) / PQ_BLOCK * m * 16;
+    header.codebooks_offset = align_up(sizeof(header), PQ_ALIGNMENT);
+    header.codes_offset = align_up(header.codebooks_offset + codebook_bytes, PQ_ALIGNMENT);
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("Unable to open PQ index for writing");
+        return 1;
+    }
+
+    int err = fwrite(&header, sizeof(header), 1, fp) != 1;
+    err |= write_padding(fp, sizeof(header), header.codebooks_offset);
+    if (codebook_bytes > 0) {
+        err |= fwrite(codebooks, 1, (size_t)codebook_bytes, fp) != codebook_bytes;
+    }
+    err |= write_padding(fp, header.codebooks_offset + codebook_bytes, header.codes_offset);
+    if (code_bytes > 0) {
+        err |= fwrite(codes, 1, (size_t)code_bytes, fp) != code_bytes;
+    }
+    err |= fclose(fp) != 0;
+
+    if (err) {
+        fprintf(stderr, "Error writing PQ index %s\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+int PqIndex::open(const char* filename, const float* data, size_t rows, size_t dim, size_t row_stride) {
+    close();
+    if (map_file_readonly(filename, file)) {
+        return 1;
+    }
+
+    PqHeader header;
+    if (file.size < sizeof(header)) {
+        fprintf(stderr, "PQ index %s is truncated\n", filename);
+        close();
+        return 1;
+    }
+    memcpy(&header, file.data, sizeof(header));
+
+    if (memcmp(header.magic, PQ_MAGIC, sizeof(PQ_MAGIC)) != 0 || header.version != PQ_VERSION) {
+        fprintf(stderr, "%s is not a PQ index (or has an unsupported version)\n", filename);
+        close();
+        return 1;
+    }
+    if (header.rows != rows || header.dim != dim) {
+        fprintf(stderr, "PQ index %s was built over %llu x %llu features, not %zu x %zu\n", filename,
+                (unsigned long long)header.rows, (unsigned long long)header.dim, rows, dim);
+        close();
+        return 1;
+    }
+
+    // both sections aligned and inside the file; written so that a corrupt header cannot overflow the sums
+    uint64_t blocks = header.rows / PQ_BLOCK + (header.rows % PQ_BLOCK != 0);
+    bool ok = header.m >= 1 && header.m <= PQ_MAX_M && header.m <= header.dim &&
+              header.dsub == (header.dim + header.m - 1) / header.m &&
+              header.codebooks_offset % PQ_ALIGNMENT == 0 && header.codes_offset % PQ_ALIGNMENT == 0 &&
+              header.codebooks_offset <= file.size &&
+              header.dsub <= (file.size - header.codebooks_offset) / sizeof(float) / (header.m * PQ_CENTROIDS) &&
+              header.codes_offset <= file.size && blocks <= (file.size - header.codes_offset) / (header.m * 16);
+    if (!ok) {
+        fprintf(stderr, "PQ index %s is corrupt\n", filename);
+        close();
+        return 1;
+    }
+
+    codebooks = (const float*)(file.data + header.codebooks_offset);
+    codes = (const uint8_t*)(file.data + header.codes_offset);
+    vectors = data;
+    count = rows;
+    cols = dim;
+    stride = row_stride;
+    m = header.m;
+    dsub = (size_t)header.dsub;
+    return 0;
+}
+
+void PqIndex::close() {
+    unmap_file(file);
+    codebook_data.clear();
+    code_data.clear();
+    codebooks = nullptr;
+    codes = nullptr;
+    vectors = nullptr;
+    count = cols = stride = m = dsub = 0;
+}
+
+std::vector<std::pair<float, size_t>> PqIndex::search(const float* query, size_t k, size_t rerank,
+                                                      const std::function<bool(size_t)>& skipRow) const {
+    std::vector<std::pair<float, size_t>> results;
+    if (count == 0 || k == 0) return results;
+
+    // distances from each query sub-vector to the 16 centroids, quantized to bytes with one scale for all
+    // sub-quantizers so the sums stay comparable: estimate = sum / scale + sum of the per-table minimums
+    std::vector<float> q(m * dsub, 0.0f), table(m * PQ_CENTROIDS);
+    std::copy(query, query + cols, q.begin());
+    float bias = 0, delta = 0;
+    for (size_t s = 0; s < m; s++) {
+        float* t = &table[s * PQ_CENTROIDS];
+        for (size_t c = 0; c < PQ_CENTROIDS; c++) {
+            t[c] = ssdDistance(&q[s * dsub], codebooks + (s * PQ_CENTROIDS + c) * dsub, dsub);
+        }
+        const float low = *std::min_element(t, t + PQ_CENTROIDS);
+        delta = std::max(delta, *std::max_element(t, t + PQ_CENTROIDS) - low);
+        bias += low;
+        for (size_t c = 0; c < PQ_CENTROIDS; c++) t[c] -= low;
+    }
+    const float scale = delta > 0 ? 255 / delta : 0;
+    std::vector<uint8_t> lut(m * PQ_CENTROIDS);
+    for (size_t i = 0; i < lut.size(); i++) {
+        lut[i] = (uint8_t)std::min(255L, std::lround(table[i] * scale));
+    }
+
+    // the candidates with the smallest estimates
+    const bool exact = vectors && rerank > 0;
+    TopK<int> candidates(std::min(count, exact ? k * rerank : k));
+    std::vector<uint16_t> sums(SCAN_BLOCKS * PQ_BLOCK);
+    const size_t nblocks = (count + PQ_BLOCK - 1) / PQ_BLOCK;
+    int limit = INT_MAX;  // once the collector is full, larger estimates cannot make it
+    for (size_t b = 0; b < nblocks; b += SCAN_BLOCKS) {
+        const size_t n = std::min(SCAN_BLOCKS, nblocks - b);
+        scan_blocks(codes + b * m * 16, n, m, lut.data(), sums.data());
+        const size_t first = b * PQ_BLOCK, end = std::min(count, first + n * PQ_BLOCK);
+        for (size_t row = first; row < end; row++) {
+            const int s = sums[row - first];
+            if (s > limit || (skipRow && skipRow(row))) continue;
+            if (candidates.push(s, row) && candidates.full()) limit = candidates.threshold();
+        }
+    }
+
+    if (!exact) {
+        for (const auto& e : candidates.sorted()) {
+            results.push_back(std::make_pair((scale > 0 ? e.first / scale : 0) + bias, e.second));
+        }
+        return results;
+    }
+
+    // re-rank with the exact SSD, best estimates first so the bound tightens early
+    TopK<float> top(k);
+    for (const auto& e : candidates.sorted()) {
+        float bound = top.full() ? top.threshold() : INFINITY;
+        top.push(ssdDistanceBounded(query, vectors + e.second * stride, cols, bound), e.second);
+    }
+    return top.sorted();
+}
@@ -0,0 +1,110 @@
+// pq_index.h
+#ifndef PQ_INDEX_H
+#define PQ_INDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+/*
+ * Product quantization with 4-bit codes, scanned "fast-scan" style. Each vector is cut into m sub-vectors
+ * of dsub = ceil(dim / m) floats (the last one zero-padded), and each sub-vector is replaced by the index of
+ * the nearest of 16 centroids trained for that position, so a row costs m / 2 bytes instead of 4 * dim (m =
+ * dim / 8 is 64x smaller). A query turns into m tables of 16 distances quantized to bytes; those tables fit
+ * in SIMD registers and a byte shuffle (pshufb) looks up 16 or 32 codes at once. The estimated distances
+ * only pick candidates: the best k * rerank of them are re-scored with the exact SSD against the original
+ * vectors, usually the mapped feature store, so only those rows are ever read from disk.
+ *
+ * On disk (.pq), in native (little-endian) byte order, every section 64-byte aligned:
+ *
+ *   PqHeader
+ *   float codebooks[m][16][dsub]
+ *   uint8_t codes[ceil(rows / 32)][m][16]  blocks of 32 rows; byte j of sub-quantizer q holds the code of
+ *                                          row j in its low nibble and of row j + 16 in its high nibble
+ */
+#define PQ_MAGIC "CBIRPQ4"
+#define PQ_VERSION 1
+#define PQ_CENTROIDS 16  // 4-bit codes
+#define PQ_BLOCK 32      // rows per code block
+
+struct PqHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t m;
+    uint64_t rows;
+    uint64_t dim;
+    uint64_t dsub;
+    uint64_t codebooks_offset;
+    uint64_t codes_offset;
+};
+
+struct PqParams {
+    size_t m = 0;               // sub-quantizers, 1..256; 0 = dim / 8
+    size_t iterations = 25;     // k-means (Lloyd) iterations per sub-quantizer
+    size_t max_train = 65536;   // codebooks are trained on at most this many sampled rows
+    uint64_t seed = 100;        // training sample and initial centroids
+};
+
+class PqIndex {
+public:
+    PqIndex();
+    ~PqIndex();
+
+    /*
+     * Trains the codebooks on a sample of the rows vectors of dim floats (row i at data + i * stride) and
+     * encodes every row, on all workers of the pool; the result does not depend on the thread count. The
+     * vectors are not copied and are used to re-rank, so they have to stay unchanged while the index is used.
+     * The function returns 0 on success and 1 on error.
+     */
+    int build(WorkStealingPool& pool, const float* data, size_t rows, size_t dim, size_t stride, const PqParams& params);
+
+    // Writes the codebooks and codes; returns 0 on success and 1 on error
+    int save(const char* filename) const;
+
+    /*
+     * Maps a saved index; data, rows, dim and stride describe the vectors it was built over (data may be
+     * nullptr, and search then returns the estimated distances). Returns 0 on success and 1 on error.
+     */
+    int open(const char* filename, const float* data, size_t rows, size_t dim, size_t stride);
+    void close();
+
+    /*
+     * The k nearest rows of query, best first, as (SSD, row) with ties ordered by row. The k * rerank rows
+     * with the smallest estimated distances are re-scored exactly; a larger rerank finds more of the true
+     * neighbours. With rerank 0 (or no vectors) the estimates themselves are returned. skipRow, if given,
+     * leaves rows out of the results.
+     */
+    std::vector<std::pair<float, size_t>> search(const float* query, size_t k, size_t rerank,
+                                                 const std::function<bool(size_t)>& skipRow = nullptr) const;
+
+    size_t rows() const { return count; }
+    size_t dim() const { return cols; }
+    size_t subquantizers() const { return m; }
+
+private:
+    PqIndex(const PqIndex&) = delete;
+    PqIndex& operator=(const PqIndex&) = delete;
+
+    void set_views();
+
+    MappedFile file;
+    std::vector<float> codebook_data;
+    std::vector<uint8_t> code_data;
+
+    const float* codebooks;
+    const uint8_t* codes;
+
+    const float* vectors;
+    size_t count;
+    size_t cols;
+    size_t stride;
+    size_t m;
+    size_t dsub;
+};
+
+
+#endif
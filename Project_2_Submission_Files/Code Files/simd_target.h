@@ -0,0 +1,22 @@
+// simd_target.h
+#ifndef SIMD_TARGET_H
+#define SIMD_TARGET_H
+
+/*
+ * SIMD_X86 is defined on x86 builds, which get the intrinsics. TARGET(isa) compiles a single function for
+ * that instruction set (e.g. "avx2,fma") while the rest of the binary keeps the baseline flags, so kernels
+ * for several ISAs live side by side and one is picked at runtime (see distance_kernels.h).
+ */
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET(isa)  // MSVC emits any intrinsic without per-function flags
+#else
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+
+#endif
@@ -0,0 +1,88 @@
+// spatial_pyramid.cpp
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include "spatial_pyramid.h"
+#include "integral_histogram.h"
+#include "distance_kernels.h"
+
+using namespace cv;
+using namespace std;
+
+size_t SpatialPyramid::dim() const
+{
+    size_t cells = 0;
+    for (const auto& level : levels) cells += (size_t)level.rows * level.cols;
+    return cells * bins * bins * bins;
+}
+
+const SpatialPyramid& defaultSpatialPyramid()
+{
+    static const SpatialPyramid pyramid = { { { 1, 1, 0.25f }, { 2, 2, 0.25f }, { 4, 4, 0.5f } }, 4 };
+    return pyramid;
+}
+
+vector<float> computeSpatialPyramid(const Mat& image, const SpatialPyramid& pyramid)
+{
+    if (image.empty() || image.type() != CV_8UC3 || pyramid.levels.empty()) return vector<float>();
+
+    // finest grid every level divides
+    int fineRows = 1, fineCols = 1;
+    for (const auto& level : pyramid.levels) {
+        fineRows = lcm(fineRows, level.rows);
+        fineCols = lcm(fineCols, level.cols);
+    }
+
+    const int bins = pyramid.bins;
+    const int binCount = bins * bins * bins;
+    int binOf[256];
+    for (int v = 0; v < 256; v++) binOf[v] = (v * bins) >> 8;
+
+    // the only pass over the pixels
+    vector<int> rowCell = gridCellOfPixel(image.rows, fineRows);
+    vector<int> colCell = gridCellOfPixel(image.cols, fineCols);
+    vector<uint32_t> fine((size_t)fineRows * fineCols * binCount, 0);
+    for (int y = 0; y < image.rows; y++) {
+        const uchar* p = image.ptr<uchar>(y);
+        uint32_t* cellRow = &fine[(size_t)rowCell[y] * fineCols * binCount];
+        for (int x = 0; x < image.cols; x++, p += 3) {
+            int bin = (binOf[p[0]] * bins + binOf[p[1]]) * bins + binOf[p[2]];
+            cellRow[(size_t)colCell[x] * binCount + bin]++;
+        }
+    }
+
+    // coarse cells sum the fine cells they cover; each level's cells sum to its weight
+    const double total = (double)image.rows * image.cols;
+    vector<float> feature;
+    feature.reserve(pyramid.dim());
+    vector<uint32_t> cell(binCount);
+    for (const auto& level : pyramid.levels) {
+        const int spanRows = fineRows / level.rows;
+        const int spanCols = fineCols / level.cols;
+        const double scale = level.weight / total;
+
+        for (int r = 0; r < level.rows; r++) {
+            for (int c = 0; c < level.cols; c++) {
+                fill(cell.begin(), cell.end(), 0u);
+                for (int fr = r * spanRows; fr < (r + 1) * spanRows; fr++) {
+                    for (int fc = c * spanCols; fc < (c + 1) * spanCols; fc++) {
+                        const uint32_t* src = &fine[((size_t)fr * fineCols + fc) * binCount];
+                        for (int b = 0; b < binCount; b++) cell[b] += src[b];
+                    }
+                }
+                for (int b = 0; b < binCount; b++) feature.push_back((float)(cell[b] * scale));
+            }
+        }
+    }
+    return feature;
+}
+
+vector<float> computeDefaultSpatialPyramid(const Mat& image)
+{
+    return computeSpatialPyramid(image, defaultSpatialPyramid());
+}
+
+float spatialPyramidSimilarity(const float* a, const float* b, size_t n)
+{
+    return intersectionSimilarity(a, b, n);
+}
@@ -0,0 +1,39 @@
+// spatial_pyramid.h
+#ifndef SPATIAL_PYRAMID_H
+#define SPATIAL_PYRAMID_H
+
+#include <cstddef>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct PyramidLevel {
+    int rows;      // grid cells down
+    int cols;      // grid cells across
+    float weight;  // share of the similarity this level contributes
+};
+
+/*
+ * Spatial-pyramid RGB histogram: every level splits the image into a rows x cols grid and stores one
+ * bins^3 histogram per cell. Pixels are binned once into the finest grid (the lcm of all level grids);
+ * coarser cells are sums of the fine cells they cover. Each level is scaled so its cells sum to the level
+ * weight, which makes the weighted intersection of two pyramids a plain min-sum over the whole vector.
+ */
+struct SpatialPyramid {
+    std::vector<PyramidLevel> levels;
+    int bins;  // per channel
+
+    size_t dim() const;
+};
+
+// 1x1, 2x2 and 4x4 grids of 4x4x4 histograms weighted 1/4, 1/4, 1/2 (Lazebnik et al.); the "rgb_pyramid" feature
+const SpatialPyramid& defaultSpatialPyramid();
+
+// Empty if the image is not 8-bit BGR
+std::vector<float> computeSpatialPyramid(const cv::Mat& image, const SpatialPyramid& pyramid);
+std::vector<float> computeDefaultSpatialPyramid(const cv::Mat& image);
+
+// Weighted histogram intersection of two pyramids in one contiguous pass (intersectionSimilarity)
+float spatialPyramidSimilarity(const float* a, const float* b, size_t n);
+
+
+#endif
@@ -0,0 +1,127 @@
+// thread_pool.cpp
+#include <algorithm>
+#include "thread_pool.h"
+
+static thread_local int worker_index = -1;
+
+int WorkStealingPool::current_worker() {
+    return worker_index;
+}
+
+WorkStealingPool::WorkStealingPool(int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < num_threads; i++) {
+        queues.emplace_back(new TaskQueue());
+    }
+    for (int i = 0; i < num_threads; i++) {
+        workers.emplace_back(&WorkStealingPool::worker_loop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+void WorkStealingPool::parallel_for(size_t n, const std::function<void(size_t)>& fn) {
+    if (n == 0) return;
+
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+
+    {
+        std::lock_guard<std::mutex> lock(m);
+        body = &fn;
+        error = nullptr;
+        remaining = n;
+    }
+
+    // deal the indices out round-robin, so neighbouring items start on different workers.
+    // body is set first: a worker still leaving the previous job may already pick these up.
+    size_t nq = queues.size();
+    for (size_t q = 0; q < nq; q++) {
+        std::lock_guard<std::mutex> lock(queues[q]->m);
+        for (size_t i = q; i < n; i += nq) {
+            queues[q]->tasks.push_back(i);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m);
+        generation++;
+    }
+    wake.notify_all();
+
+    std::unique_lock<std::mutex> lock(m);
+    finished.wait(lock, [this] { return remaining.load() == 0; });
+    body = nullptr;
+
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void WorkStealingPool::worker_loop(int id) {
+    worker_index = id;
+    unsigned long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        run_tasks(id);
+    }
+}
+
+bool WorkStealingPool::pop_local(int id, size_t& task) {
+    TaskQueue& q = *queues[id];
+    std::lock_guard<std::mutex> lock(q.m);
+    if (q.tasks.empty()) return false;
+    task = q.tasks.front();
+    q.tasks.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::steal(int id, size_t& task) {
+    size_t nq = queues.size();
+    for (size_t k = 1; k < nq; k++) {
+        TaskQueue& q = *queues[(id + k) % nq];
+        std::lock_guard<std::mutex> lock(q.m);
+        if (!q.tasks.empty()) {
+            task = q.tasks.back();
+            q.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+// All tasks of a job are queued before the workers wake, so once nothing is left to pop or
+// steal this worker is done with the job.
+void WorkStealingPool::run_tasks(int id) {
+    size_t task;
+    while (pop_local(id, task) || steal(id, task)) {
+        try {
+            (*body)(task);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(m);
+            if (!error) error = std::current_exception();
+        }
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(m);
+            finished.notify_all();
+        }
+    }
+}
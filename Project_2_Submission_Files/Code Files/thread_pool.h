@@ -0,0 +1,66 @@
+// thread_pool.h
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed-size pool with one task deque per worker. parallel_for deals the indices out round-robin;
+ * a worker pops from the front of its own deque and, once that is empty, steals from the back of
+ * the others, so a few expensive items (e.g. huge JPEGs) do not leave the rest of the pool idle.
+ */
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int num_threads = 0); // 0 = one thread per core
+    ~WorkStealingPool();
+
+    int size() const { return (int)workers.size(); }
+
+    // Index in [0, size()) of the pool worker running the calling thread, -1 outside any pool;
+    // lets a body keep per-worker state (e.g. one result heap per worker) without locking.
+    static int current_worker();
+
+    // Runs body(i) for every i in [0, n) and returns when all are done.
+    // The first exception thrown by body is rethrown here.
+    void parallel_for(size_t n, const std::function<void(size_t)>& body);
+
+private:
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    struct TaskQueue {
+        std::mutex m;
+        std::deque<size_t> tasks;
+    };
+
+    void worker_loop(int id);
+    bool pop_local(int id, size_t& task);
+    bool steal(int id, size_t& task);
+    void run_tasks(int id);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+
+    std::mutex m;
+    std::condition_variable wake;     // a new job was posted (or the pool is stopping)
+    std::condition_variable finished; // the current job has no tasks left
+    std::mutex job_mutex;             // one parallel_for at a time
+    unsigned long generation = 0;
+    bool stopping = false;
+
+    const std::function<void(size_t)>* body = nullptr;
+    std::atomic<size_t> remaining{ 0 };
+    std::exception_ptr error;
+};
+
+
+#endif
@@ -0,0 +1,76 @@
+// top_k.h
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/*
+ * Keeps the k best (score, id) pairs seen during a scan in a bounded heap whose front is the worst kept
+ * entry, so a candidate that cannot make the cut is rejected with one compare against it. Ids are row or
+ * slot numbers; callers turn only the winners into filenames. Lower scores win by default (distances);
+ * pass higherIsBetter for similarities. Equal scores are ordered by id the same way, which reproduces the
+ * old sort of (score, filename) pairs whenever ids follow filename order.
+ */
+template <typename Score>
+class TopK {
+public:
+    typedef std::pair<Score, size_t> Entry;
+
+    explicit TopK(size_t k, bool higherIsBetter = false) : k(k), higherIsBetter(higherIsBetter)
+    {
+        heap.reserve(k);
+    }
+
+    // Returns true if the candidate is among the k best so far
+    bool push(Score score, size_t id)
+    {
+        if (heap.size() == k) {
+            if (k == 0 || !better(Entry(score, id), heap.front())) return false;
+            std::pop_heap(heap.begin(), heap.end(), Better{ higherIsBetter });
+            heap.back() = Entry(score, id);
+        }
+        else {
+            heap.push_back(Entry(score, id));
+        }
+        std::push_heap(heap.begin(), heap.end(), Better{ higherIsBetter });
+        return true;
+    }
+
+    // Adds everything another collector kept (e.g. one per thread)
+    void merge(const TopK& other)
+    {
+        for (const Entry& e : other.heap) push(e.first, e.second);
+    }
+
+    bool full() const { return heap.size() == k; }
+    size_t size() const { return heap.size(); }
+
+    // Score a candidate has to beat once the collector is full
+    Score threshold() const { return heap.front().first; }
+
+    // The kept entries, best first
+    std::vector<Entry> sorted() const
+    {
+        std::vector<Entry> entries(heap);
+        std::sort(entries.begin(), entries.end(), Better{ higherIsBetter });
+        return entries;
+    }
+
+private:
+    struct Better {
+        bool higherIsBetter;
+        bool operator()(const Entry& a, const Entry& b) const { return higherIsBetter ? b < a : a < b; }
+    };
+
+    bool better(const Entry& a, const Entry& b) const { return Better{ higherIsBetter }(a, b); }
+
+    size_t k;
+    bool higherIsBetter;
+    std::vector<Entry> heap;  // max-heap under Better: front() is the worst kept entry
+};
+
+
+#endif
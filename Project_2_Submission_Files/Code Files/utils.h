@@ -5,13 +5,22 @@
 #include <vector>
 #include <string>
 #include <opencv2/opencv.hpp>
+#include "csv_utils.h"
 
-int append_image_data_csv(const char* filename, const char* image_filename, std::vector<float>& image_data, int reset_file = 0);
-int read_image_data_csv(const char* filename, std::vector<std::string>& filenames, std::vector<std::vector<float>>& data, int echo_file = 0);
-
+/*
+ * 3x3 Sobel gradients of an 8-bit 3-channel image as CV_16SC3. Only interior pixels are filtered; the
+ * one-pixel border of every output is zero. X is right minus left smoothed [1 2 1] vertically, Y is
+ * bottom minus top smoothed horizontally. Each returns 0 on success and 1 for other image types.
+ */
 int sobelY3x3(cv::Mat& src, cv::Mat& dst);
 
 int sobelX3x3(cv::Mat& src, cv::Mat& dst);
 
+// Both gradients in one pass over the source
+int sobelXY3x3(const cv::Mat& src, cv::Mat& dx, cv::Mat& dy);
+
+// Any subset of dx, dy and the CV_8UC3 magnitude (sqrt(dx^2 + dy^2), rounded and saturated); null outputs are skipped
+int sobelXY3x3(const cv::Mat& src, cv::Mat* dx, cv::Mat* dy, cv::Mat* mag);
+
 
 #endif
\ No newline at end of file